@@ -0,0 +1,181 @@
+#ifndef ANY_ANGLE_HPP
+#define ANY_ANGLE_HPP
+
+#include <cmath>
+#include <vector>
+
+#include "search_scratch.hpp"
+#include "utility.hpp"
+
+// A path made of straight segments between waypoints.
+struct any_angle_solution {
+  // Waypoints from source to goal; consecutive waypoints see each other
+  std::vector<vertex_descriptor> waypoints;
+  // Travel time along the segments in island seconds
+  distance length;
+};
+
+// Travel time along the straight segment from cell a to cell b.
+//
+// The segment is rasterised with Bresenham's algorithm and the slope model is
+// integrated step by step: each of the n steps covers 1/n of the Euclidean
+// length and climbs the elevation difference between consecutive cells.  For
+// two adjacent cells this is exactly the grid edge cost.  Returns false if the
+// line crosses a barrier or squeezes diagonally between two barriers.
+inline bool lineTime(const maze& m, std::size_t a, std::size_t b, double& time) {
+  const long w = long(m.length(0));
+  long x = long(a) % w, y = long(a) / w;
+  const long x1 = long(b) % w, y1 = long(b) / w;
+  const long dx = std::abs(x1 - x), dy = -std::abs(y1 - y);
+  const long sx = x < x1 ? 1 : -1, sy = y < y1 ? 1 : -1;
+  const long steps = std::max(dx, -dy);
+  if (steps == 0) {
+    time = 0;
+    return true;
+  }
+  const double run2 = double(dx*dx + dy*dy)/double(steps*steps);
+
+  time = 0;
+  long err = dx + dy;
+  std::size_t cur = a;
+  while (x != x1 || y != y1) {
+    long e2 = 2*err;
+    bool stepX = e2 >= dy, stepY = e2 <= dx;
+    if (stepX && stepY &&
+        !m.passable(std::size_t((x + sx) + y*w)) &&
+        !m.passable(std::size_t(x + (y + sy)*w)))
+      return false;
+    if (stepX) {err += dy; x += sx;}
+    if (stepY) {err += dx; y += sy;}
+    std::size_t next = std::size_t(x + y*w);
+    if (!m.passable(next))
+      return false;
+    time += slopeTime(run2, int(m.m_elev[next]) - int(m.m_elev[cur]));
+    cur = next;
+  }
+  return true;
+}
+
+// Lazy Theta*: any-angle search over the 8-connected grid.
+//
+// A cell inherits its parent's parent whenever the two see each other, so
+// paths are chains of long straight segments instead of grid staircases.  The
+// line-of-sight check and the cost integration are deferred: when a cell is
+// generated its g-value is an admissible estimate (the slope model applied to
+// the whole segment at once, which never exceeds the integrated cost) and the
+// Bresenham walk is only done once the cell is popped.  If the segment is
+// blocked, or costlier than stepping from an expanded neighbour, the cell
+// falls back to the best neighbour and is requeued if its key grew.  Cells
+// holding such an estimate are marked in the scratch.
+inline bool solve_any_angle(const maze& m, vertex_descriptor source, vertex_descriptor goal,
+                            any_angle_solution& solution, search_scratch* scratch = nullptr) {
+  search_scratch local;
+  search_scratch& s = scratch ? *scratch : local;
+  s.reset(m.num_cells());
+
+  const std::size_t w = m.length(0);
+  const std::size_t h = m.length(1);
+  const std::size_t src = m.index(source);
+  const std::size_t dst = m.index(goal);
+  if (!m.passable(src) || !m.passable(dst))
+    return false;
+
+  auto heuristic = [&](std::size_t i) {
+    double dx = double(long(i % w) - long(dst % w));
+    double dy = double(long(i / w) - long(dst / w));
+    return std::sqrt(dx*dx + dy*dy);
+  };
+  // Call f(n, diagonal) for every traversable 8-neighbour of i that can be
+  // entered without cutting a barrier corner.
+  auto for_each_neighbour = [&](std::size_t i, auto f) {
+    const long x = long(i % w), y = long(i / w);
+    for (long ny = y - 1; ny <= y + 1; ++ny)
+      for (long nx = x - 1; nx <= x + 1; ++nx) {
+        if ((nx == x && ny == y) || nx < 0 || ny < 0 || nx >= long(w) || ny >= long(h))
+          continue;
+        std::size_t n = std::size_t(nx + ny*long(w));
+        if (!m.passable(n))
+          continue;
+        bool diag = nx != x && ny != y;
+        if (diag && !m.passable(std::size_t(nx + y*long(w))) &&
+            !m.passable(std::size_t(x + ny*long(w))))
+          continue;
+        f(n, diag);
+      }
+  };
+  auto adjacentTime = [&](std::size_t a, std::size_t b, bool diag) {
+    return slopeTime(diag ? 2 : 1, int(m.m_elev[b]) - int(m.m_elev[a]));
+  };
+  auto estimate = [&](std::size_t a, std::size_t b) {
+    double dx = double(long(a % w) - long(b % w));
+    double dy = double(long(a / w) - long(b / w));
+    return slopeTime(dx*dx + dy*dy, int(m.m_elev[b]) - int(m.m_elev[a]));
+  };
+
+  open_list open;
+  s.set(src, 0, src);
+  open.push(open_entry(heuristic(src), uint32_t(src)));
+
+  while (!open.empty()) {
+    open_entry top = open.top();
+    open.pop();
+    std::size_t u = top.second;
+    if (s.closed(u) || top.first != s.dist(u) + heuristic(u))
+      continue;
+
+    if (s.marked(u)) {
+      double g = std::numeric_limits<double>::infinity();
+      std::size_t parent = s.pred(u);
+      double t;
+      if (lineTime(m, parent, u, t))
+        g = s.dist(parent) + t;
+      for_each_neighbour(u, [&](std::size_t n, bool diag) {
+        if (s.closed(n) && s.dist(n) + adjacentTime(n, u, diag) < g) {
+          g = s.dist(n) + adjacentTime(n, u, diag);
+          parent = n;
+        }
+      });
+      bool grew = g > s.dist(u);
+      s.set(u, g, parent);
+      if (grew) {
+        open.push(open_entry(g + heuristic(u), uint32_t(u)));
+        continue;
+      }
+    }
+
+    if (u == dst) {
+      solution.waypoints.clear();
+      for (std::size_t v = dst; v != src; v = s.pred(v))
+        solution.waypoints.push_back(m.cell(v));
+      solution.waypoints.push_back(m.cell(src));
+      std::reverse(solution.waypoints.begin(), solution.waypoints.end());
+      solution.length = s.dist(dst);
+      return true;
+    }
+    s.close(u);
+
+    const std::size_t parent = s.pred(u);
+    for_each_neighbour(u, [&](std::size_t n, bool diag) {
+      if (s.closed(n))
+        return;
+      // Path 2: assume the parent of u sees n, verify when n is popped.
+      if (parent != u) {
+        double g = s.dist(parent) + estimate(parent, n);
+        if (g < s.dist(n)) {
+          s.set(n, g, parent);
+          s.mark(n);
+          open.push(open_entry(g + heuristic(n), uint32_t(n)));
+        }
+        return;
+      }
+      double g = s.dist(u) + adjacentTime(u, n, diag);
+      if (g < s.dist(n)) {
+        s.set(n, g, u);
+        open.push(open_entry(g + heuristic(n), uint32_t(n)));
+      }
+    });
+  }
+  return false;
+}
+
+#endif
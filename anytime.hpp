@@ -0,0 +1,219 @@
+#ifndef ANYTIME_HPP
+#define ANYTIME_HPP
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <vector>
+
+#include "search_scratch.hpp"
+#include "utility.hpp"
+
+// A solution reported by the anytime search.
+struct anytime_solution {
+  // Cells from source to goal, in travel order
+  std::vector<vertex_descriptor> path;
+  // Travel time along the path in island seconds
+  distance length;
+  // Proven suboptimality: length <= bound * optimal length
+  double bound;
+};
+
+typedef std::function<void(const anytime_solution&)> anytime_callback;
+
+// Anytime Repairing A* (ARA*).
+//
+// The search starts with the heuristic inflated by initialWeight, which finds
+// a path quickly, and then lowers the weight by weightStep per iteration,
+// reusing the g-values of the previous iteration so that each pass only
+// repairs the part of the search space that changed.  After every pass the
+// best path so far is handed to improved() together with its proven bound.  The search stops when
+// the weight reaches 1 (the path is then optimal), when the deadline passes or
+// when *cancel becomes true.  Returns true if any path was found; best holds
+// the last one.
+class anytime_search {
+public:
+  anytime_search(const maze& m):m_maze(m) {};
+
+  bool solve(vertex_descriptor source, vertex_descriptor goal,
+             std::chrono::steady_clock::time_point deadline,
+             anytime_solution& best,
+             const anytime_callback& improved = anytime_callback(),
+             const std::atomic<bool>* cancel = nullptr,
+             double initialWeight = 3.0, double weightStep = 0.5);
+
+private:
+  double heuristic(std::size_t i) const {
+    const std::size_t w = m_maze.length(0);
+    return double(std::abs(long(i % w) - long(m_goal % w)) +
+                  std::abs(long(i / w) - long(m_goal / w)));
+  }
+  double key(std::size_t i) const {return m_scratch.dist(i) + m_weight*heuristic(i);}
+  bool expired() const;
+  // Expand cells until the goal is the cheapest inflated key.  Returns false
+  // if the deadline or cancellation interrupted the pass.
+  bool improve_path();
+  // Rebuild the open list from OPEN and INCONS under a new weight and return
+  // the smallest unweighted f-value among them.
+  double rebuild_open(double weight);
+  // The smallest unweighted f-value in OPEN and INCONS, without changing
+  // them.  A lower bound on the optimal cost at any point of a pass.
+  double open_lower_bound() const;
+
+  const maze& m_maze;
+  search_scratch m_scratch;
+  open_list m_open;
+  std::vector<uint32_t> m_incons;
+  std::size_t m_source;
+  std::size_t m_goal;
+  double m_weight;
+  std::chrono::steady_clock::time_point m_deadline;
+  const std::atomic<bool>* m_cancel;
+};
+
+
+inline bool anytime_search::expired() const {
+  if (m_cancel && m_cancel->load(std::memory_order_relaxed))
+    return true;
+  return std::chrono::steady_clock::now() >= m_deadline;
+}
+
+inline bool anytime_search::improve_path() {
+  std::size_t expansions = 0;
+  while (!m_open.empty() && m_open.top().first < m_scratch.dist(m_goal)) {
+    // Checked before the pop, so that an interrupted pass leaves every
+    // unexpanded cell in OPEN for open_lower_bound()
+    if ((++expansions & 1023) == 0 && expired())
+      return false;
+    open_entry top = m_open.top();
+    m_open.pop();
+    std::size_t u = top.second;
+    if (m_scratch.closed(u) || top.first != key(u))
+      continue;
+    m_scratch.close(u);
+
+    const double gu = m_scratch.dist(u);
+    m_maze.for_each_edge(u, [&](std::size_t v, double w) {
+      double gv = gu + w;
+      if (gv < m_scratch.dist(v)) {
+        m_scratch.set(v, gv, u);
+        if (!m_scratch.closed(v))
+          m_open.push(open_entry(key(v), uint32_t(v)));
+        else
+          m_incons.push_back(uint32_t(v));
+      }
+    });
+  }
+  return true;
+}
+
+inline double anytime_search::rebuild_open(double weight) {
+  std::vector<uint32_t> cells;
+  cells.swap(m_incons);
+  while (!m_open.empty()) {
+    std::size_t u = m_open.top().second;
+    if (!m_scratch.closed(u) && m_open.top().first == key(u))
+      cells.push_back(uint32_t(u));
+    m_open.pop();
+  }
+  m_weight = weight;
+
+  double fmin = std::numeric_limits<double>::infinity();
+  std::vector<open_entry> entries;
+  entries.reserve(cells.size());
+  // Cells listed more than once are marked in the scratch on first sight
+  for (uint32_t u : cells) {
+    if (m_scratch.marked(u))
+      continue;
+    m_scratch.mark(u);
+    fmin = std::min(fmin, m_scratch.dist(u) + heuristic(u));
+    entries.push_back(open_entry(0, u));
+  }
+  for (open_entry& e : entries) {
+    m_scratch.mark(e.second, false);
+    e.first = key(e.second);
+  }
+  m_open = open_list(std::greater<open_entry>(), std::move(entries));
+  return fmin;
+}
+
+inline double anytime_search::open_lower_bound() const {
+  double fmin = std::numeric_limits<double>::infinity();
+  for (open_list open = m_open; !open.empty(); open.pop()) {
+    std::size_t u = open.top().second;
+    if (!m_scratch.closed(u) && open.top().first == key(u))
+      fmin = std::min(fmin, m_scratch.dist(u) + heuristic(u));
+  }
+  for (uint32_t u : m_incons)
+    fmin = std::min(fmin, m_scratch.dist(u) + heuristic(u));
+  return fmin;
+}
+
+inline bool anytime_search::solve(vertex_descriptor source, vertex_descriptor goal,
+                                  std::chrono::steady_clock::time_point deadline,
+                                  anytime_solution& best,
+                                  const anytime_callback& improved,
+                                  const std::atomic<bool>* cancel,
+                                  double initialWeight, double weightStep) {
+  m_source = m_maze.index(source);
+  m_goal = m_maze.index(goal);
+  m_deadline = deadline;
+  m_cancel = cancel;
+  m_weight = std::max(1.0, initialWeight);
+  m_scratch.reset(m_maze.num_cells());
+  m_incons.clear();
+  m_open = open_list();
+
+  if (!m_maze.passable(m_source) || !m_maze.passable(m_goal))
+    return false;
+
+  m_scratch.set(m_source, 0, m_source);
+  m_open.push(open_entry(key(m_source), uint32_t(m_source)));
+
+  bool found = false;
+  // Whether best.bound holds a proven bound, and whether best changed since
+  // improved() last saw it
+  bool proven = false, fresh = false;
+  while (true) {
+    bool complete = improve_path();
+    if (m_scratch.reached(m_goal) &&
+        (!found || m_scratch.dist(m_goal) < best.length)) {
+      found = true;
+      fresh = true;
+      best.path = m_scratch.path(m_maze, m_source, m_goal);
+      best.length = m_scratch.dist(m_goal);
+    }
+    if (!complete) {
+      // Interrupted mid-pass: the weight is not proven, but OPEN and INCONS
+      // still bound the optimal cost.  A shorter path keeps any earlier bound.
+      if (found) {
+        double fmin = std::min(best.length, open_lower_bound());
+        double bound = fmin > 0 ? best.length / fmin : std::numeric_limits<double>::infinity();
+        best.bound = std::max(1.0, proven ? std::min(best.bound, bound) : bound);
+        if (fresh && improved)
+          improved(best);
+      }
+      return found;
+    }
+
+    // The open and inconsistent cells bound the optimal cost from below.
+    double lastWeight = m_weight;
+    double fmin = rebuild_open(std::max(1.0, m_weight - weightStep));
+    if (!found)
+      return false;
+    double bound = fmin > 0 ? std::min(lastWeight, best.length / fmin) : lastWeight;
+    best.bound = std::max(1.0, bound);
+    proven = true;
+    fresh = false;
+    if (improved)
+      improved(best);
+    if (best.bound <= 1.0 || lastWeight <= 1.0 || expired()) {
+      if (lastWeight <= 1.0)
+        best.bound = 1.0;
+      return true;
+    }
+    m_scratch.reset_closed();
+  }
+}
+
+#endif
@@ -0,0 +1,1261 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "utility.hpp"
+#include "any_angle.hpp"
+#include "anytime.hpp"
+#include "cell_layout.hpp"
+#include "cell_memory.hpp"
+#include "compact_index.hpp"
+#include "distributed_search.hpp"
+#include "eikonal.hpp"
+#include "external_search.hpp"
+#include "flow_field.hpp"
+#include "free_spans.hpp"
+#include "isochrone.hpp"
+#include "multi_source.hpp"
+#include "path_database.hpp"
+#include "plateau_search.hpp"
+#include "sssp.hpp"
+#include "tiled_map.hpp"
+#include "travel_matrix.hpp"
+#include "visualizer.h"
+
+// Benchmarks on synthetic islands.
+//
+//   benchmark external [size]    external-memory search against the flat
+//                                in-memory search on a map that fits in RAM
+//   benchmark layout [size]      A* expansion rate with row-major, blocked and
+//                                Z-order cell layouts
+//   benchmark memory [size]      A* expansion rate with per-cell planes on
+//                                small pages and on huge pages
+//   benchmark build [size]       make_maze time with one thread and with all
+//   benchmark compact [size]     A* over all cells against A* over the
+//                                compact traversable-cell graph
+//   benchmark spans [size]       component labelling by span flood fill
+//                                against cell flood fill, and fast sweeping
+//                                over spans
+//   benchmark plateau [size]     A* against plateau_search on the rolling
+//                                island, a terraced one and a mesa one
+//   benchmark cpd [size]         build a compressed path database for 16
+//                                depots and answer depot queries from it
+//                                against A*
+//   benchmark dispatch [size]    send the first of 32 rovers to each goal,
+//                                one multi-source search against 32 A*s
+//   benchmark isochrone [size]   cells reachable within 5, 15 and 30
+//                                minutes, against a full Dijkstra
+//   benchmark flow [size]        build a flow field, follow it from many
+//                                cells, then repair it after an override
+//                                change and compare with a rebuild
+//   benchmark tiles [size]       tiled maps with power-of-two and other tile
+//                                sizes read back cell by cell and searched
+//   benchmark distributed [size] partitioned search with 2, 3 and 4 worker
+//                                processes, against Dijkstra
+//   benchmark sssp [size]        delta-stepping on 1..N threads against
+//                                Dijkstra, cell by cell
+//   benchmark matrix [size]      travel time matrix with repeated and
+//                                unreachable targets, against Dijkstra
+//   benchmark eikonal [size]     fast marching against fast sweeping, and
+//                                both against Dijkstra over the slowness
+//   benchmark anyangle [size]    any-angle paths against the grid optimum,
+//                                every segment checked for line of sight
+//   benchmark pyramid [size]     BMP tile pyramids with a path marked in the
+//                                map, for both downsampling filters
+//   benchmark bmp [size]         writeBMPFile against writeBMP, byte for byte,
+//                                for every row padding
+//   benchmark anytime [size]     ARA* to completion and under short
+//                                deadlines, against Dijkstra
+
+namespace {
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Set once any comparison fails, so that the run fails whatever its mode returns
+bool mismatched = false;
+
+// Suffix for a line reporting a comparison
+const char* verdict(bool same)
+{
+    if (!same)
+        mismatched = true;
+    return same ? "" : "  MISMATCH";
+}
+
+// Rolling hills with lakes and a few rivers, deterministic for a given size.
+void syntheticIsland(size_t size, std::vector<uint8_t>& elevation, std::vector<uint8_t>& overrides)
+{
+    elevation.assign(size * size, 0);
+    overrides.assign(size * size, 0);
+    for (size_t y = 0; y < size; ++y)
+    {
+        for (size_t x = 0; x < size; ++x)
+        {
+            double h = 120 + 60 * sin(x / 97.0) * cos(y / 61.0) + 30 * sin((x + y) / 23.0);
+            size_t i = x + y * size;
+            elevation[i] = uint8_t(std::max(1.0, std::min(255.0, h)));
+            if (sin(x / 41.0) * sin(y / 37.0) > 0.8)
+                overrides[i] |= OF_WATER_BASIN;
+            if ((x + 3 * y / 4) % 509 < 3 && y % 400 > 40)
+                overrides[i] |= OF_RIVER_MARSH;
+        }
+    }
+}
+
+// The synthetic island with its elevation cut into terraces of 24 steps, so
+// that most of the land is wide plateaus.
+void terracedIsland(size_t size, std::vector<uint8_t>& elevation, std::vector<uint8_t>& overrides)
+{
+    syntheticIsland(size, elevation, overrides);
+    for (uint8_t& e : elevation)
+        e = uint8_t(std::max(1, e / 24 * 24));
+}
+
+// Square mesas a sixteenth of the map wide, each at one of four
+// elevations, with a lake in every few.
+void mesaIsland(size_t size, std::vector<uint8_t>& elevation, std::vector<uint8_t>& overrides)
+{
+    elevation.assign(size * size, 0);
+    overrides.assign(size * size, 0);
+    const size_t block = std::max<size_t>(1, size / 16);
+    for (size_t y = 0; y < size; ++y)
+    {
+        for (size_t x = 0; x < size; ++x)
+        {
+            uint32_t hash = uint32_t((x / block) * 73856093u ^ (y / block) * 19349663u);
+            hash = (hash ^ (hash >> 13)) * 0x5bd1e995u;
+            hash ^= hash >> 15;
+            size_t i = x + y * size;
+            elevation[i] = uint8_t(40 + (hash % 4) * 12);
+            if (hash % 5 == 0 && x % block > block / 4 && y % block > block / 4 && x % block < block / 2)
+                overrides[i] |= OF_WATER_BASIN;
+        }
+    }
+}
+
+typedef std::vector<std::pair<vertex_descriptor, vertex_descriptor> > query_list;
+
+// Fixed spread of queries across the island, corner to corner and edge to edge.
+query_list layoutQueries(const maze& m, size_t size)
+{
+    query_list queries;
+    const size_t lo = size / 16, hi = size - size / 16, mid = size / 2;
+    const size_t ends[][4] = {{lo, hi, hi, lo}, {lo, lo, hi, hi}, {lo, mid, hi, mid}, {mid, lo, mid, hi},
+                              {hi, hi, lo, lo}, {mid, mid, lo, hi}};
+    for (const auto& e : ends)
+    {
+        vertex_descriptor source = {{e[0], e[1]}}, goal = {{e[2], e[3]}};
+        if (m.passable(m.index(source)) && m.passable(m.index(goal)))
+            queries.push_back(std::make_pair(source, goal));
+    }
+    return queries;
+}
+
+typedef void (*island_generator)(size_t, std::vector<uint8_t>&, std::vector<uint8_t>&);
+
+// A generated island, its maze and its fixed queries
+struct island
+{
+    explicit island(size_t size, island_generator generate = syntheticIsland)
+        : size(size)
+        , m(build(generate))
+        , queries(layoutQueries(m, size))
+    {
+    }
+
+    size_t size;
+    std::vector<uint8_t> elevation, overrides;
+    maze m;
+    query_list queries;
+
+private:
+    maze build(island_generator generate)
+    {
+        generate(size, elevation, overrides);
+        return make_maze(size, size, overrides, elevation);
+    }
+};
+
+bool saveFile(const std::string& path, const std::vector<uint8_t>& data)
+{
+    std::ofstream out(path.c_str(), std::ofstream::binary);
+    out.write((const char*)&data[0], data.size());
+    return out.good();
+}
+
+bool loadFile(const std::string& path, std::vector<uint8_t>& data)
+{
+    std::ifstream in(path.c_str(), std::ifstream::binary);
+    data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return in.good() || in.eof();
+}
+
+int benchmarkExternal(size_t size)
+{
+    island world(size);
+    const maze& m = world.m;
+    vertex_descriptor source = m.cell(size / 16 + (size - size / 16) * size);
+    vertex_descriptor goal = m.cell(size - size / 16 + (size / 16) * size);
+
+    auto start = std::chrono::steady_clock::now();
+    travel_time_matrix inMemory = travel_times(m, {source}, {goal}, 1);
+    double inMemoryTime = secondsSince(start);
+
+    if (!saveFile("bench_elevation.data", world.elevation) || !saveFile("bench_overrides.data", world.overrides) ||
+        !write_tiled_map("bench_elevation.data", "bench_overrides.data", size, size, "bench_map.fptm"))
+    {
+        std::cerr << "Could not write the tiled map." << std::endl;
+        return 1;
+    }
+    tiled_map map;
+    map.open("bench_map.fptm");
+    std::vector<vertex_descriptor> path;
+    distance length = 0;
+    external_stats stats;
+    start = std::chrono::steady_clock::now();
+    // Keep a quarter of the state blocks resident so that the search has to spill
+    external_options options;
+    options.resident_blocks = std::max<size_t>(1, (size / map.tile_size()) * (size / map.tile_size()) / 4);
+    bool found = external_solve(map, source, goal, path, length, options, &stats);
+    double externalTime = secondsSince(start);
+
+    std::cout << "map " << size << "x" << size << std::endl;
+    std::cout << "in-memory: " << inMemory.at(0, 0) << " island seconds in " << inMemoryTime << " s" << std::endl;
+    std::cout << "external:  " << (found ? length : -1) << " island seconds in " << externalTime << " s, "
+              << stats.settled << " settled, " << stats.block_loads << " block loads, "
+              << stats.block_stores << " block stores, " << stats.bytes_read / (1 << 20) << " MB read, "
+              << stats.bytes_written / (1 << 20) << " MB written" << std::endl;
+    std::cout << "overhead:  " << externalTime / inMemoryTime << "x" << std::endl;
+
+    std::remove("bench_elevation.data");
+    std::remove("bench_overrides.data");
+    std::remove("bench_map.fptm");
+    return found && length == inMemory.at(0, 0) ? 0 : 1;
+}
+
+template <typename Grid>
+bool timeLayout(const char* name, const Grid& grid,
+                const query_list& queries,
+                std::vector<distance>& lengths)
+{
+    search_scratch scratch;
+    scratch.reset(grid.num_cells());
+    size_t expanded = 0;
+    bool same = true;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t q = 0; q < queries.size(); ++q)
+    {
+        size_t expansions = 0;
+        distance length = std::numeric_limits<distance>::infinity();
+        grid_astar(grid, queries[q].first, queries[q].second, scratch, length, &expansions);
+        expanded += expansions;
+        if (lengths.size() <= q)
+            lengths.push_back(length);
+        same = same && lengths[q] == length;
+    }
+    double seconds = secondsSince(start);
+    std::cout << name << expanded << " expansions in " << seconds << " s, "
+              << expanded / seconds / 1e6 << " M expansions/s" << verdict(same) << std::endl;
+    return same;
+}
+
+int benchmarkLayout(size_t size)
+{
+    island world(size);
+    const maze& m = world.m;
+    const query_list& queries = world.queries;
+
+    std::cout << "map " << size << "x" << size << ", " << queries.size() << " queries" << std::endl;
+    std::vector<distance> lengths;
+    bool same = timeLayout("maze:          ", m, queries, lengths);
+    same = timeLayout("row-major:     ", layout_grid<row_major_layout>(m), queries, lengths) && same;
+    same = timeLayout("blocked 8x8:   ", layout_grid<blocked_layout<8> >(m), queries, lengths) && same;
+    same = timeLayout("blocked 16x16: ", layout_grid<blocked_layout<16> >(m), queries, lengths) && same;
+    same = timeLayout("morton:        ", layout_grid<morton_layout>(m), queries, lengths) && same;
+    return same ? 0 : 1;
+}
+
+int benchmarkMemory(size_t size)
+{
+    std::vector<uint8_t> elevation, overrides;
+    syntheticIsland(size, elevation, overrides);
+
+    struct
+    {
+        const char* name;
+        bool transparent;
+        bool explicitPages;
+    } const policies[] = {{"small pages:       ", false, false},
+                          {"transparent huge:  ", true, false},
+                          {"explicit huge:     ", true, true}};
+    std::vector<distance> lengths;
+    bool same = true;
+    for (const auto& p : policies)
+    {
+        cell_memory_policy policy;
+        policy.transparent_huge_pages = p.transparent;
+        policy.explicit_huge_pages = p.explicitPages;
+        policy.touch_threads = default_threads();
+        set_cell_memory_policy(policy);
+        // Every plane is allocated after the policy change
+        maze m = make_maze(size, size, overrides, elevation);
+        same = timeLayout(p.name, m, layoutQueries(m, size), lengths) && same;
+        std::cout << "  " << cell_memory_usage() << std::endl;
+    }
+    return same ? 0 : 1;
+}
+
+int benchmarkBuild(size_t size)
+{
+    std::vector<uint8_t> elevation, overrides;
+    syntheticIsland(size, elevation, overrides);
+    const int repeats = 10;
+    for (unsigned threads : {1u, default_threads()})
+    {
+        auto start = std::chrono::steady_clock::now();
+        size_t components = 0;
+        for (int r = 0; r < repeats; ++r)
+            components = make_maze(size, size, overrides, elevation, threads).num_components();
+        std::cout << "make_maze " << size << "x" << size << ", " << threads << " thread" << (threads == 1 ? "" : "s")
+                  << ": " << secondsSince(start) / repeats * 1000 << " ms, " << components << " components"
+                  << std::endl;
+    }
+    return 0;
+}
+
+int benchmarkCompact(size_t size)
+{
+    island world(size);
+    const maze& m = world.m;
+    const query_list& queries = world.queries;
+    // dist, pred, stamp and closed stamp per cell
+    const size_t scratchPerCell = sizeof(double) + 3 * sizeof(uint32_t);
+
+    auto start = std::chrono::steady_clock::now();
+    compact_graph compact(m);
+    double buildTime = secondsSince(start);
+
+    std::cout << "map " << size << "x" << size << ", " << compact.cells().size() << " of " << m.num_cells()
+              << " cells traversable, " << queries.size() << " queries" << std::endl;
+    std::cout << "compact graph built in " << buildTime * 1000 << " ms, " << compact.memory_bytes() / (1 << 20)
+              << " MB" << std::endl;
+    std::vector<distance> lengths;
+    bool same = timeLayout("all cells:     ", m, queries, lengths);
+    std::cout << "  search state " << m.num_cells() * scratchPerCell / (1 << 20) << " MB" << std::endl;
+    same = timeLayout("compact:       ", compact, queries, lengths) && same;
+    std::cout << "  search state " << compact.num_cells() * scratchPerCell / (1 << 20) << " MB" << std::endl;
+    return same ? 0 : 1;
+}
+
+// Component labels by flood fill from cell to cell, the reference for the
+// span flood fill.
+uint32_t cellComponents(const maze& m, std::vector<uint32_t>& label)
+{
+    label.assign(m.num_cells(), 0);
+    uint32_t components = 0;
+    std::vector<size_t> stack;
+    for (size_t i = 0; i < m.num_cells(); ++i)
+    {
+        if (!m.passable(i) || label[i] != 0)
+            continue;
+        label[i] = ++components;
+        stack.push_back(i);
+        while (!stack.empty())
+        {
+            size_t u = stack.back();
+            stack.pop_back();
+            m.for_each_neighbour(u, [&](size_t v) {
+                if (label[v] == 0)
+                {
+                    label[v] = components;
+                    stack.push_back(v);
+                }
+            });
+        }
+    }
+    return components;
+}
+
+int benchmarkSpans(size_t size)
+{
+    island world(size);
+    const maze& m = world.m;
+
+    auto start = std::chrono::steady_clock::now();
+    free_spans spans(m);
+    double buildTime = secondsSince(start);
+    std::cout << "map " << size << "x" << size << ", " << spans.size() << " spans over " << spans.cells()
+              << " cells, " << double(spans.cells()) / spans.size() << " cells per span" << std::endl;
+    std::cout << "spans built in " << buildTime * 1000 << " ms, " << spans.memory_bytes() / 1024 << " KB"
+              << std::endl;
+
+    std::vector<uint32_t> cellLabels, spanLabels;
+    start = std::chrono::steady_clock::now();
+    uint32_t cellCount = cellComponents(m, cellLabels);
+    double cellTime = secondsSince(start);
+    start = std::chrono::steady_clock::now();
+    uint32_t spanCount = label_span_components(spans, spanLabels);
+    double spanTime = secondsSince(start);
+    // Both number components in row-major order of their first cell, as
+    // make_maze does
+    bool same = cellCount == spanCount && spanCount == m.num_components();
+    for (size_t k = 0; k < spans.size(); ++k)
+        for (uint32_t x = spans[k].begin; x < spans[k].end; ++x)
+        {
+            size_t i = x + size_t(spans[k].row) * size;
+            same = same && cellLabels[i] == spanLabels[k] && m.component(i) == spanLabels[k];
+        }
+    std::cout << "cell flood fill: " << cellCount << " components in " << cellTime * 1000 << " ms" << std::endl;
+    std::cout << "span flood fill: " << spanCount << " components in " << spanTime * 1000 << " ms"
+              << verdict(same) << std::endl;
+
+    const query_list& queries = world.queries;
+    if (!queries.empty())
+    {
+        vertex_descriptor goal = queries[0].second;
+        start = std::chrono::steady_clock::now();
+        time_field T = fast_sweeping(m, spans, goal, 1);
+        double sweepTime = secondsSince(start);
+        free_spans isochrone = level_set(spans, T, T[m.index(queries[0].first)]);
+        std::cout << "fast sweeping over spans: " << sweepTime * 1000 << " ms, " << isochrone.cells()
+                  << " cells within the time to (" << queries[0].first[0] << ", " << queries[0].first[1] << ")"
+                  << std::endl;
+    }
+    return same ? 0 : 1;
+}
+
+int benchmarkPlateau(size_t size)
+{
+    bool same = true;
+    const char* names[] = {"rolling", "terraced", "mesa"};
+    const island_generator generators[] = {syntheticIsland, terracedIsland, mesaIsland};
+    for (int map = 0; map < 3; ++map)
+    {
+        island world(size, generators[map]);
+        const maze& m = world.m;
+        const query_list& queries = world.queries;
+        auto start = std::chrono::steady_clock::now();
+        plateau_search plateaus(m);
+        double buildTime = secondsSince(start);
+        size_t interior = 0;
+        for (size_t i = 0; i < m.num_cells(); ++i)
+            interior += plateaus.interior(i);
+        std::cout << names[map] << " map " << size << "x" << size << ", " << queries.size() << " queries, "
+                  << plateaus.num_rectangles() << " rectangles in " << buildTime * 1000 << " ms, "
+                  << 100.0 * interior / m.num_cells() << "% of cells interior" << std::endl;
+
+        std::vector<distance> lengths;
+        same = timeLayout("  A*:             ", m, queries, lengths) && same;
+        search_scratch scratch;
+        size_t expanded = 0;
+        start = std::chrono::steady_clock::now();
+        for (size_t q = 0; q < queries.size(); ++q)
+        {
+            size_t expansions = 0;
+            distance length = std::numeric_limits<distance>::infinity();
+            plateaus.solve(queries[q].first, queries[q].second, scratch, length, nullptr, &expansions);
+            expanded += expansions;
+            same = same && length == lengths[q];
+        }
+        std::cout << "  plateau_search: " << expanded << " expansions in " << secondsSince(start) << " s"
+                  << verdict(same) << std::endl;
+    }
+    return same ? 0 : 1;
+}
+
+int benchmarkPathDatabase(size_t size)
+{
+    island world(size);
+    const maze& m = world.m;
+
+    // A 4x4 grid of depots, each moved right to the first traversable cell
+    std::vector<vertex_descriptor> depots;
+    for (size_t k = 0; k < 16; ++k)
+    {
+        size_t i = (size / 8 + (k % 4) * size / 4) + (size / 8 + (k / 4) * size / 4) * size;
+        while (i + 1 < m.num_cells() && !m.passable(i))
+            ++i;
+        depots.push_back(m.cell(i));
+    }
+    auto start = std::chrono::steady_clock::now();
+    if (!build_path_database(m, depots, "bench_depots.fpcd"))
+    {
+        std::cerr << "Could not write the path database." << std::endl;
+        return 1;
+    }
+    double buildTime = secondsSince(start);
+    path_database db;
+    if (!db.open("bench_depots.fpcd", m))
+    {
+        std::cerr << "Could not open the path database." << std::endl;
+        return 1;
+    }
+    size_t traversable = m.num_cells() - m.num_barriers();
+    std::cout << "map " << size << "x" << size << ", " << db.num_depots() << " depots" << std::endl;
+    std::cout << "built in " << buildTime << " s, " << db.num_runs() << " runs, " << db.file_bytes() / 1024
+              << " KB, " << 100.0 * db.file_bytes() / (db.num_depots() * traversable / 4.0)
+              << "% of 2 bits per cell" << std::endl;
+
+    // Every depot from a fixed spread of starts
+    std::vector<vertex_descriptor> starts;
+    for (size_t k = 0; k < 32; ++k)
+    {
+        size_t i = (k * 2654435761u) % m.num_cells();
+        if (m.passable(i))
+            starts.push_back(m.cell(i));
+    }
+    std::vector<distance> lengths;
+    size_t steps = 0;
+    bool same = true;
+    start = std::chrono::steady_clock::now();
+    for (size_t d = 0; d < db.num_depots(); ++d)
+        for (const vertex_descriptor& s : starts)
+        {
+            std::vector<vertex_descriptor> path;
+            distance length = std::numeric_limits<distance>::infinity();
+            db.path_to(d, s, path, length);
+            lengths.push_back(length);
+            steps += path.size();
+        }
+    double dbTime = secondsSince(start);
+    search_scratch scratch;
+    start = std::chrono::steady_clock::now();
+    for (size_t d = 0, q = 0; d < db.num_depots(); ++d)
+        for (const vertex_descriptor& s : starts)
+        {
+            distance length = std::numeric_limits<distance>::infinity();
+            grid_astar(m, s, db.depot(d), scratch, length);
+            same = same && length == lengths[q++];
+        }
+    double astarTime = secondsSince(start);
+    std::cout << lengths.size() << " queries, " << steps << " path cells" << std::endl;
+    std::cout << "path database: " << dbTime * 1000 << " ms, " << dbTime / lengths.size() * 1e6 << " us per query"
+              << verdict(same) << std::endl;
+    std::cout << "A*:            " << astarTime * 1000 << " ms, " << astarTime / lengths.size() * 1e6
+              << " us per query" << std::endl;
+    db.close();
+    std::remove("bench_depots.fpcd");
+    return same ? 0 : 1;
+}
+
+int benchmarkDispatch(size_t size)
+{
+    island world(size);
+    const maze& m = world.m;
+    const query_list& queries = world.queries;
+
+    // Rovers spread over the map, each free after up to five minutes
+    std::vector<search_source> rovers;
+    for (size_t k = 0; rovers.size() < 32 && k < 4096; ++k)
+    {
+        size_t i = (k * 2654435761u) % m.num_cells();
+        if (m.passable(i))
+        {
+            search_source s = {m.cell(i), distance((k * 37) % 300)};
+            rovers.push_back(s);
+        }
+    }
+    std::cout << "map " << size << "x" << size << ", " << rovers.size() << " rovers, " << queries.size()
+              << " goals" << std::endl;
+
+    search_scratch scratch;
+    std::vector<distance> arrivals;
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& q : queries)
+    {
+        distance best = std::numeric_limits<distance>::infinity();
+        for (const search_source& rover : rovers)
+        {
+            distance length = std::numeric_limits<distance>::infinity();
+            if (grid_astar(m, rover.cell, q.second, scratch, length))
+                best = std::min(best, rover.offset + length);
+        }
+        arrivals.push_back(best);
+    }
+    std::cout << "  one A* per rover:   " << secondsSince(start) << " s" << std::endl;
+
+    std::vector<multi_source_result> results(queries.size());
+    std::vector<bool> found(queries.size());
+    size_t expanded = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t q = 0; q < queries.size(); ++q)
+    {
+        size_t expansions = 0;
+        found[q] = multi_source_solve(m, rovers, queries[q].second, scratch, results[q], &expansions);
+        expanded += expansions;
+    }
+    std::cout << "  multi_source_solve: " << secondsSince(start) << " s, " << expanded << " expansions";
+
+    // The winner's own search must arrive at the same time
+    bool same = true;
+    for (size_t q = 0; q < queries.size(); ++q)
+    {
+        if (!found[q])
+        {
+            same = same && arrivals[q] == std::numeric_limits<distance>::infinity();
+            continue;
+        }
+        const search_source& winner = rovers[results[q].source];
+        distance length = std::numeric_limits<distance>::infinity();
+        grid_astar(m, winner.cell, queries[q].second, scratch, length);
+        same = same && results[q].arrival == arrivals[q] && winner.offset + length == arrivals[q] &&
+               results[q].path.front() == winner.cell && results[q].path.back() == queries[q].second;
+    }
+    std::cout << verdict(same) << std::endl;
+    return same ? 0 : 1;
+}
+
+int benchmarkIsochrone(size_t size)
+{
+    island world(size);
+    const maze& m = world.m;
+    vertex_descriptor source = world.queries.front().first;
+
+    auto start = std::chrono::steady_clock::now();
+    shortest_path_tree tree;
+    dijkstra(m, source, tree);
+    std::cout << "map " << size << "x" << size << ", full Dijkstra in " << secondsSince(start) << " s" << std::endl;
+
+    bool same = true;
+    search_scratch scratch;
+    isochrone reach;
+    for (double minutes : {5.0, 15.0, 30.0})
+    {
+        const distance budget = minutes * 60;
+        start = std::chrono::steady_clock::now();
+        reachable_within(m, source, budget, scratch, reach);
+        double time = secondsSince(start);
+        size_t inside = 0;
+        for (size_t i = 0; i < m.num_cells(); ++i)
+        {
+            inside += tree.dist[i] <= budget;
+            same = same && reach.contains(i) == (tree.dist[i] <= budget);
+        }
+        for (size_t k = 0; k < reach.cells.size(); ++k)
+            same = same && reach.times[k] == float(tree.dist[reach.cells[k]]);
+        same = same && reach.cells.size() == inside;
+        std::cout << "  " << minutes << " minutes: " << reach.cells.size() << " cells in " << time * 1000 << " ms"
+                  << verdict(same) << std::endl;
+    }
+    return same ? 0 : 1;
+}
+
+// Same steps and times in every cell
+bool sameField(const maze& m, const flow_field& a, const flow_field& b)
+{
+    for (size_t i = 0; i < m.num_cells(); ++i)
+        if (a.time(i) != b.time(i) && !(std::isinf(a.time(i)) && std::isinf(b.time(i))))
+            return false;
+        else if (a.reaches(i) && i != a.goal() && a.step(i) != b.step(i))
+            return false;
+    return true;
+}
+
+int benchmarkFlow(size_t size)
+{
+    island world(size);
+    const maze& m = world.m;
+    vertex_descriptor goal = world.queries.front().second;
+
+    flow_field_cache cache;
+    auto start = std::chrono::steady_clock::now();
+    const flow_field& field = cache.get(m, goal);
+    std::cout << "map " << size << "x" << size << ", field built in " << secondsSince(start) << " s, "
+              << field.memory_bytes() / (1024 * 1024) << " MB" << std::endl;
+    start = std::chrono::steady_clock::now();
+    cache.get(m, goal);
+    std::cout << "  cached lookup in " << secondsSince(start) * 1e6 << " us" << std::endl;
+
+    // Agents scattered over the map follow the field
+    shortest_path_tree tree;
+    dijkstra(m, goal, tree);
+    bool same = true;
+    size_t agents = 0, steps = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < 4096; ++k)
+    {
+        size_t i = (k * 2654435761u) % m.num_cells();
+        if (!field.reaches(i))
+            continue;
+        ++agents;
+        distance length = 0;
+        for (; i != field.goal(); i = field.next(i), ++steps)
+            length += m.stepCost(i, field.next(i));
+        same = same && length == tree.dist[(k * 2654435761u) % m.num_cells()];
+    }
+    std::cout << "  " << agents << " agents, " << steps << " steps in " << secondsSince(start) * 1000 << " ms"
+              << verdict(same) << std::endl;
+
+    // A lake floods a block of the map
+    std::vector<uint32_t> changed;
+    for (size_t y = 0; y < size; ++y)
+        for (size_t x = 0; x < size; ++x)
+        {
+            size_t i = x + y * size;
+            uint8_t before = world.overrides[i];
+            if (x >= size / 2 && x < size / 2 + 40 && y >= size / 2 && y < size / 2 + 40)
+                world.overrides[i] |= OF_WATER_BASIN;
+            if (world.overrides[i] != before)
+                changed.push_back(uint32_t(i));
+        }
+    start = std::chrono::steady_clock::now();
+    maze after = make_maze(size, size, world.overrides, world.elevation);
+    std::cout << "  " << changed.size() << " cells changed, maze rebuilt in " << secondsSince(start) * 1000
+              << " ms" << std::endl;
+    start = std::chrono::steady_clock::now();
+    cache.update(after, changed);
+    std::cout << "  field repaired in " << secondsSince(start) * 1000 << " ms" << std::endl;
+    flow_field fresh;
+    start = std::chrono::steady_clock::now();
+    fresh.build(after, goal);
+    same = sameField(after, cache.get(after, goal), fresh) && same;
+    std::cout << "  field rebuilt in  " << secondsSince(start) * 1000 << " ms" << verdict(same)
+              << std::endl;
+    return same ? 0 : 1;
+}
+
+int benchmarkTiles(size_t size)
+{
+    island world(size);
+    const maze& m = world.m;
+    if (!saveFile("bench_elevation.data", world.elevation) || !saveFile("bench_overrides.data", world.overrides))
+    {
+        std::cerr << "Could not write the map." << std::endl;
+        return 1;
+    }
+    bool same = true;
+    search_scratch scratch;
+    for (size_t tileSize : {256, 100, 32, 7})
+    {
+        if (!write_tiled_map("bench_elevation.data", "bench_overrides.data", size, size, "bench_map.fptm", tileSize))
+        {
+            std::cerr << "Could not write the tiled map." << std::endl;
+            return 1;
+        }
+        // Few resident tiles, so that tiles are mapped and unmapped many times
+        tiled_map map(4);
+        bool ok = map.open("bench_map.fptm");
+        auto start = std::chrono::steady_clock::now();
+        for (size_t y = 0; ok && y < size; ++y)
+            for (size_t x = 0; x < size; ++x)
+            {
+                size_t i = x + y * size;
+                ok = ok && map.at(x, y) == (m.passable(i) ? world.elevation[i] : 0);
+            }
+        double scanTime = secondsSince(start);
+        for (const auto& q : world.queries)
+        {
+            std::vector<vertex_descriptor> path;
+            distance tiled = 0, length = std::numeric_limits<distance>::infinity();
+            grid_astar(m, q.first, q.second, scratch, length);
+            ok = ok && solve_tiled(map, q.first, q.second, path, tiled) && tiled == length;
+        }
+        same = same && ok;
+        std::cout << "tile size " << tileSize << ": scanned in " << scanTime * 1000 << " ms, "
+                  << map.stats().misses << " tiles mapped" << verdict(ok) << std::endl;
+    }
+    std::remove("bench_elevation.data");
+    std::remove("bench_overrides.data");
+    std::remove("bench_map.fptm");
+    return same ? 0 : 1;
+}
+
+int benchmarkDistributed(size_t size)
+{
+    island world(size);
+    const maze& m = world.m;
+    if (!saveFile("bench_elevation.data", world.elevation) || !saveFile("bench_overrides.data", world.overrides) ||
+        !write_tiled_map("bench_elevation.data", "bench_overrides.data", size, size, "bench_map.fptm"))
+    {
+        std::cerr << "Could not write the tiled map." << std::endl;
+        return 1;
+    }
+    std::cout << "map " << size << "x" << size << ", " << world.queries.size() << " queries" << std::endl;
+    bool same = true;
+    for (const auto& q : world.queries)
+    {
+        shortest_path_tree tree;
+        auto start = std::chrono::steady_clock::now();
+        dijkstra(m, q.first, tree);
+        const distance optimal = tree.dist[m.index(q.second)];
+        std::cout << "  Dijkstra: " << optimal << " in " << secondsSince(start) << " s" << std::endl;
+        for (unsigned workers : {2u, 3u, 4u})
+        {
+            distributed_options options;
+            options.partitions = workers;
+            distributed_stats stats;
+            std::vector<vertex_descriptor> path;
+            distance length = 0;
+            start = std::chrono::steady_clock::now();
+            bool found = distributed_solve("bench_map.fptm", q.first, q.second, path, length, options, &stats);
+            bool ok = found == (optimal < std::numeric_limits<distance>::infinity()) &&
+                      (!found || (length == optimal && path.front() == q.first && path.back() == q.second));
+            same = same && ok;
+            std::cout << "  " << workers << " workers: " << (found ? length : -1) << " in " << secondsSince(start)
+                      << " s, " << stats.rounds << " rounds, " << stats.updates << " boundary updates"
+                      << verdict(ok) << std::endl;
+        }
+    }
+    std::remove("bench_elevation.data");
+    std::remove("bench_overrides.data");
+    std::remove("bench_map.fptm");
+    return same ? 0 : 1;
+}
+
+int benchmarkSSSP(size_t size)
+{
+    island world(size);
+    const maze& m = world.m;
+    const unsigned most = std::max(default_threads(), 4u);
+    std::cout << "map " << size << "x" << size << ", " << world.queries.size() << " sources" << std::endl;
+    bool same = true;
+    for (const auto& q : world.queries)
+    {
+        shortest_path_tree reference;
+        auto start = std::chrono::steady_clock::now();
+        dijkstra(m, q.first, reference);
+        const double serial = secondsSince(start);
+        std::cout << "  Dijkstra: " << serial << " s" << std::endl;
+        for (unsigned threads = 1; threads <= most; ++threads)
+        {
+            shortest_path_tree tree;
+            start = std::chrono::steady_clock::now();
+            delta_stepping(m, q.first, tree, 2.0, threads);
+            const double parallel = secondsSince(start);
+            size_t wrong = 0;
+            for (size_t i = 0; i < m.num_cells(); ++i)
+                if (tree.dist[i] != reference.dist[i] || tree.pred[i] != reference.pred[i])
+                    ++wrong;
+            same = same && wrong == 0;
+            std::cout << "  delta-stepping, " << threads << " thread" << (threads == 1 ? "" : "s") << ": "
+                      << parallel << " s, speedup " << serial / parallel << ", " << wrong << " cells differ"
+                      << verdict(wrong == 0) << std::endl;
+        }
+    }
+    return same ? 0 : 1;
+}
+
+int benchmarkMatrix(size_t size)
+{
+    island world(size);
+    const maze& m = world.m;
+    std::vector<vertex_descriptor> sources, targets;
+    for (const auto& q : world.queries)
+    {
+        sources.push_back(q.first);
+        targets.push_back(q.second);
+    }
+    // The first goal 300 times over, and a cell on another island
+    for (int k = 0; k < 300; ++k)
+        targets.push_back(world.queries.front().second);
+    const std::size_t home = m.component(m.index(sources.front()));
+    for (size_t i = 0; i < m.num_cells(); ++i)
+        if (m.passable(i) && m.component(i) != home)
+        {
+            targets.push_back(m.cell(i));
+            break;
+        }
+
+    auto start = std::chrono::steady_clock::now();
+    travel_time_matrix matrix = travel_times(m, sources, targets);
+    double matrixTime = secondsSince(start);
+    bool same = true;
+    start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < sources.size(); ++r)
+    {
+        shortest_path_tree tree;
+        dijkstra(m, sources[r], tree);
+        for (size_t c = 0; c < targets.size(); ++c)
+            same = same && matrix.at(r, c) == tree.dist[m.index(targets[c])];
+    }
+    std::cout << "map " << size << "x" << size << ", " << sources.size() << " x " << targets.size()
+              << " matrix in " << matrixTime << " s, full Dijkstras in " << secondsSince(start) << " s"
+              << verdict(same) << std::endl;
+    return same ? 0 : 1;
+}
+
+int benchmarkEikonal(size_t size)
+{
+    island world(size);
+    const maze& m = world.m;
+    const free_spans spans(m);
+    const std::vector<float> f = slownessField(m);
+    bool same = true;
+    std::cout << "map " << size << "x" << size << ", " << world.queries.size() << " goals" << std::endl;
+    for (const auto& q : world.queries)
+    {
+        auto start = std::chrono::steady_clock::now();
+        time_field marched = fast_marching(m, q.second);
+        double marchTime = secondsSince(start);
+        start = std::chrono::steady_clock::now();
+        time_field swept = fast_sweeping(m, spans, q.second);
+        double sweepTime = secondsSince(start);
+        // Both solve the same discrete equation, so they may only differ by
+        // float rounding.  A Godunov update never exceeds the smaller
+        // neighbour plus the cell's slowness, so neither may be slower than
+        // Dijkstra with that as the cost of entering a cell.
+        std::vector<double> bound(m.num_cells(), std::numeric_limits<double>::infinity());
+        open_list open;
+        bound[m.index(q.second)] = 0;
+        open.push(open_entry(0, uint32_t(m.index(q.second))));
+        while (!open.empty())
+        {
+            open_entry top = open.top();
+            open.pop();
+            if (top.first != bound[top.second])
+                continue;
+            m.for_each_neighbour(top.second, [&](size_t v) {
+                if (top.first + f[v] < bound[v])
+                {
+                    bound[v] = top.first + f[v];
+                    open.push(open_entry(bound[v], uint32_t(v)));
+                }
+            });
+        }
+        double worst = 0;
+        size_t reachDiffers = 0, aboveGrid = 0;
+        for (size_t i = 0; i < m.num_cells(); ++i)
+        {
+            const bool reached = marched[i] < kInfiniteTime;
+            if (reached != (swept[i] < kInfiniteTime) || reached != (bound[i] < kInfiniteTime))
+            {
+                ++reachDiffers;
+                continue;
+            }
+            if (!reached)
+                continue;
+            worst = std::max(worst, std::abs(double(marched[i]) - swept[i]) / std::max(1.0, double(marched[i])));
+            if (std::max(marched[i], swept[i]) > bound[i] * (1 + 1e-4))
+                ++aboveGrid;
+        }
+        bool ok = reachDiffers == 0 && aboveGrid == 0 && worst <= 1e-4;
+        same = same && ok;
+        std::cout << "  marching " << marchTime * 1000 << " ms, sweeping " << sweepTime * 1000
+                  << " ms, largest relative difference " << worst << ", " << aboveGrid
+                  << " cells above Dijkstra, " << reachDiffers << " reached differently" << verdict(ok)
+                  << std::endl;
+    }
+    return same ? 0 : 1;
+}
+
+int benchmarkAnyAngle(size_t size)
+{
+    island world(size);
+    const maze& m = world.m;
+    search_scratch scratch;
+    bool same = true;
+    std::cout << "map " << size << "x" << size << ", " << world.queries.size() << " queries" << std::endl;
+    for (const auto& q : world.queries)
+    {
+        shortest_path_tree tree;
+        dijkstra(m, q.first, tree);
+        const distance grid = tree.dist[m.index(q.second)];
+        any_angle_solution solution;
+        auto start = std::chrono::steady_clock::now();
+        bool found = solve_any_angle(m, q.first, q.second, solution, &scratch);
+        double seconds = secondsSince(start);
+        // Every segment must be clear, and together they must add up to the
+        // reported length.  Float edge costs against double segment times
+        // leave a little slack in the comparison with the grid.
+        bool ok = found == (grid < std::numeric_limits<distance>::infinity());
+        if (found)
+        {
+            double walked = 0;
+            for (size_t k = 1; ok && k < solution.waypoints.size(); ++k)
+            {
+                double t;
+                ok = lineTime(m, m.index(solution.waypoints[k - 1]), m.index(solution.waypoints[k]), t);
+                walked += t;
+            }
+            ok = ok && solution.waypoints.front() == q.first && solution.waypoints.back() == q.second &&
+                 std::abs(walked - solution.length) <= 1e-9 * solution.length &&
+                 solution.length <= grid * (1 + 1e-6);
+        }
+        same = same && ok;
+        std::cout << "  grid " << grid << ", any-angle " << (found ? solution.length : -1) << " over "
+                  << solution.waypoints.size() << " waypoints in " << seconds << " s" << verdict(ok) << std::endl;
+    }
+    return same ? 0 : 1;
+}
+
+int benchmarkPyramid(size_t size)
+{
+    using visualizer::IPV_PATH;
+    using visualizer::IPV_WATER;
+    using visualizer::PyramidOptions;
+    typedef visualizer::detail::PyramidWriter PyramidWriter;
+    const std::vector<visualizer::Polyline> noPaths;
+    bool same = true;
+
+    // One pixel from each child: a path wins, water needs all four (max) or three
+    // (mean), and only elevations are filtered.
+    const uint8_t blocks[4][4] = {
+        {IPV_PATH, 200, 200, 200},
+        {IPV_WATER, IPV_WATER, IPV_WATER, 100},
+        {100, 200, IPV_WATER, IPV_PATH},
+        {100, 200, 150, 50}};
+    const uint8_t expected[2][4] = {
+        {IPV_PATH, 100, IPV_PATH, 200},
+        {IPV_PATH, IPV_WATER, IPV_PATH, 125}};
+    for (int filter = 0; filter < 2; ++filter)
+    {
+        PyramidOptions options;
+        options.tileSize = 2;
+        options.filter = visualizer::DownsampleFilter(filter);
+        PyramidWriter writer("bench_pyramid", 4, 4, noPaths, options);
+        std::vector<uint8_t> children[4], tile;
+        const std::vector<uint8_t>* childPointers[4];
+        for (int c = 0; c < 4; ++c)
+        {
+            children[c].assign(blocks[c], blocks[c] + 4);
+            childPointers[c] = &children[c];
+        }
+        writer.downsample(childPointers, tile);
+        bool ok = std::equal(tile.begin(), tile.end(), expected[filter]);
+        same = same && ok;
+        std::cout << (filter == visualizer::DOWNSAMPLE_MAX ? "max" : "mean") << " filter on markers" << verdict(ok)
+                  << std::endl;
+    }
+
+    // A whole pyramid with the first query's path marked in the map itself, so it only
+    // shows up at the top through downsampling
+    island world(size);
+    const maze& m = world.m;
+    std::vector<uint8_t> onPath(m.num_cells(), 0);
+    shortest_path_tree tree;
+    dijkstra(m, world.queries.front().first, tree);
+    const size_t source = m.index(world.queries.front().first);
+    for (size_t i = m.index(world.queries.front().second); tree.dist[i] < kInfiniteTime; i = tree.pred[i])
+    {
+        onPath[i] = 1;
+        if (i == source)
+            break;
+    }
+    auto pixel = [&](size_t x, size_t y) {
+        const size_t i = x + y * size;
+        return !m.passable(i) ? uint8_t(IPV_WATER)
+                              : onPath[i] ? uint8_t(IPV_PATH)
+                                          : std::max(world.elevation[i], uint8_t(visualizer::IPV_ELEVATION_BEGIN));
+    };
+    for (int filter = 0; filter < 2; ++filter)
+    {
+        PyramidOptions options;
+        options.tileSize = 64;
+        options.filter = visualizer::DownsampleFilter(filter);
+        options.threads = default_threads();
+        auto start = std::chrono::steady_clock::now();
+        bool written = visualizer::writeTilePyramid("bench_pyramid", size, size, pixel, noPaths, options);
+        double seconds = secondsSince(start);
+        const unsigned maxZoom = PyramidWriter("bench_pyramid", size, size, noPaths, options).maxZoom();
+
+        // Every tile must be there; remove them again, deepest first
+        size_t tiles = 0, missing = 0, pathPixels = 0;
+        for (unsigned z = maxZoom + 1; z-- > 0;)
+        {
+            const std::string level = "bench_pyramid/" + std::to_string(z);
+            for (size_t tx = 0; tx < (size_t(1) << z); ++tx)
+            {
+                const std::string column = level + "/" + std::to_string(tx);
+                for (size_t ty = 0; ty < (size_t(1) << z); ++ty)
+                {
+                    std::vector<uint8_t> bmp;
+                    const std::string path = column + "/" + std::to_string(ty) + ".bmp";
+                    ++tiles;
+                    if (!loadFile(path, bmp) || bmp.size() < 14)
+                    {
+                        ++missing;
+                        continue;
+                    }
+                    if (z == 0)
+                    {
+                        const size_t offset = bmp[10] | bmp[11] << 8 | bmp[12] << 16 | size_t(bmp[13]) << 24;
+                        pathPixels =
+                            std::count(bmp.begin() + std::min(offset, bmp.size()), bmp.end(), uint8_t(IPV_PATH));
+                    }
+                    std::remove(path.c_str());
+                }
+                std::remove(column.c_str());
+            }
+            std::remove(level.c_str());
+        }
+        std::remove("bench_pyramid");
+        bool ok = written && missing == 0 && pathPixels > 0;
+        same = same && ok;
+        std::cout << (filter == visualizer::DOWNSAMPLE_MAX ? "max" : "mean") << " filter: " << tiles << " tiles of "
+                  << options.tileSize << " px in " << seconds * 1000 << " ms, " << missing << " missing, "
+                  << pathPixels << " path pixels at zoom 0" << verdict(ok) << std::endl;
+    }
+    return same ? 0 : 1;
+}
+
+int benchmarkBMP(size_t size)
+{
+    bool same = true;
+    const size_t height = size / 2 + 1;
+    auto filter = [](size_t, size_t, uint8_t value) {
+        return value < 40 ? uint8_t(visualizer::IPV_WATER) : value;
+    };
+    // Widths with every remainder modulo 4, so every amount of row padding
+    for (size_t width = size; width < size + 4; ++width)
+    {
+        std::vector<uint8_t> elevation(width * height);
+        uint32_t state = uint32_t(width);
+        for (uint8_t& e : elevation)
+        {
+            state = state * 1664525u + 1013904223u;
+            e = uint8_t(state >> 24);
+        }
+        visualizer::Overlay marks(width, height);
+        const std::array<size_t, 2> corners[] = {{{0, 0}}, {{width - 1, height - 1}}, {{width - 1, 0}}};
+        marks.drawPolyline(corners, corners + 3, visualizer::IPV_PATH);
+        const std::vector<const visualizer::Overlay*> layers(1, &marks);
+
+        for (unsigned threads : {1u, std::max(default_threads(), 3u)})
+        {
+            std::ostringstream streamed, layered;
+            visualizer::writeBMP(streamed, &elevation[0], width, height, filter, threads);
+            visualizer::writeBMP(layered, &elevation[0], width, height, layers, threads);
+            std::vector<uint8_t> mapped, mappedLayers;
+            bool written = visualizer::writeBMPFile("bench_image.bmp", &elevation[0], width, height, filter, threads) &&
+                           loadFile("bench_image.bmp", mapped);
+            written = visualizer::writeBMPFile("bench_image.bmp", &elevation[0], width, height, layers, threads) &&
+                      loadFile("bench_image.bmp", mappedLayers) && written;
+            std::remove("bench_image.bmp");
+            const std::string a = streamed.str(), b = layered.str();
+            bool ok = written && std::vector<uint8_t>(a.begin(), a.end()) == mapped &&
+                      std::vector<uint8_t>(b.begin(), b.end()) == mappedLayers;
+            same = same && ok;
+            std::cout << width << "x" << height << ", " << threads << " thread" << (threads == 1 ? "" : "s") << ": "
+                      << mapped.size() << " bytes, rows padded by " << visualizer::detail::bmpRowBytes(width) - width
+                      << verdict(ok) << std::endl;
+        }
+    }
+    return same ? 0 : 1;
+}
+
+int benchmarkAnytime(size_t size)
+{
+    island world(size);
+    const maze& m = world.m;
+    std::cout << "map " << size << "x" << size << ", " << world.queries.size() << " queries" << std::endl;
+    bool same = true;
+    anytime_search search(m);
+    for (const auto& q : world.queries)
+    {
+        shortest_path_tree tree;
+        dijkstra(m, q.first, tree);
+        const distance optimal = tree.dist[m.index(q.second)];
+        std::cout << "  optimal " << optimal << std::endl;
+
+        // To completion, then interrupted after 1 ms and at fractions of the
+        // complete run, which land in the middle of later passes.  Every
+        // answer must have been reported, and its bound must hold against the
+        // exact optimum.
+        double complete = 0;
+        for (double ms : {1e9, 1.0, -0.1, -0.3, -0.6, -0.9})
+        {
+            if (ms < 0)
+                ms = -ms * complete;
+            anytime_solution best;
+            size_t reports = 0;
+            distance reported = 0;
+            auto start = std::chrono::steady_clock::now();
+            auto deadline = start + std::chrono::microseconds(long(ms * 1000));
+            bool found = search.solve(q.first, q.second, deadline, best, [&](const anytime_solution& s) {
+                ++reports;
+                reported = s.length;
+            });
+            double seconds = secondsSince(start);
+            if (ms > 1e6)
+                complete = seconds * 1000;
+            bool ok = !found || (reports > 0 && reported == best.length && best.bound >= 1 &&
+                                 best.length >= optimal && best.length <= best.bound * optimal * (1 + 1e-12));
+            if (ms > 1e6)
+                ok = ok && found && best.length == optimal && best.bound == 1;
+            same = same && ok;
+            std::cout << "    ";
+            if (ms > 1e6)
+                std::cout << "no deadline: ";
+            else
+                std::cout << ms << " ms: ";
+            if (found)
+                std::cout << best.length << ", bound " << best.bound << ", " << reports << " reports";
+            else
+                std::cout << "no path yet";
+            std::cout << " in " << seconds * 1000 << " ms" << verdict(ok) << std::endl;
+        }
+    }
+    return same ? 0 : 1;
+}
+
+int runMode(const std::string& mode, size_t size)
+{
+    if (mode == "external")
+        return benchmarkExternal(size);
+    if (mode == "layout")
+        return benchmarkLayout(size);
+    if (mode == "memory")
+        return benchmarkMemory(size);
+    if (mode == "build")
+        return benchmarkBuild(size);
+    if (mode == "compact")
+        return benchmarkCompact(size);
+    if (mode == "spans")
+        return benchmarkSpans(size);
+    if (mode == "plateau")
+        return benchmarkPlateau(size);
+    if (mode == "cpd")
+        return benchmarkPathDatabase(size);
+    if (mode == "dispatch")
+        return benchmarkDispatch(size);
+    if (mode == "isochrone")
+        return benchmarkIsochrone(size);
+    if (mode == "flow")
+        return benchmarkFlow(size);
+    if (mode == "tiles")
+        return benchmarkTiles(size);
+    if (mode == "distributed")
+        return benchmarkDistributed(size);
+    if (mode == "sssp")
+        return benchmarkSSSP(size);
+    if (mode == "matrix")
+        return benchmarkMatrix(size);
+    if (mode == "eikonal")
+        return benchmarkEikonal(size);
+    if (mode == "anyangle")
+        return benchmarkAnyAngle(size);
+    if (mode == "pyramid")
+        return benchmarkPyramid(size);
+    if (mode == "bmp")
+        return benchmarkBMP(size);
+    if (mode == "anytime")
+        return benchmarkAnytime(size);
+    return -1;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::string mode = argc > 1 ? argv[1] : "";
+    size_t size = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 2048;
+    int status = runMode(mode, size);
+    if (status < 0)
+    {
+        std::cerr << "usage: " << argv[0]
+                  << " external|layout|memory|build|compact|spans|plateau|cpd|dispatch|isochrone|flow|tiles|distributed|sssp|matrix|eikonal|anyangle|pyramid|bmp|anytime [size]"
+                  << std::endl;
+        return 1;
+    }
+    return mismatched ? 1 : status;
+}
@@ -0,0 +1,285 @@
+#ifndef CELL_LAYOUT_HPP
+#define CELL_LAYOUT_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+#include "search_scratch.hpp"
+#include "utility.hpp"
+
+// Memory layouts for per-cell arrays.
+//
+// maze::index is row-major, so the cells above and below a cell are a whole
+// row (2 KB of elevation, 16 KB of distances) away.  The layouts below keep
+// square neighbourhoods close together instead.  Each one maps map
+// coordinates to an array index, maps indices back, and steps to the four
+// neighbours of a cell on the map.  The neighbour step always yields a valid
+// array index.  When the neighbour would be off the map, the index points at
+// a padding cell that layout_grid marks impassable, so searches need no
+// bounds checks.
+
+// Row-major with a one cell guard ring.
+class row_major_layout {
+public:
+  row_major_layout(std::size_t width, std::size_t height):
+    m_width(width), m_height(height), m_stride(width + 2) {}
+
+  std::size_t size() const {return m_stride*(m_height + 2);}
+  std::size_t index(std::size_t x, std::size_t y) const {return (x + 1) + (y + 1)*m_stride;}
+  std::size_t x(std::size_t i) const {return i % m_stride - 1;}
+  std::size_t y(std::size_t i) const {return i / m_stride - 1;}
+
+  std::size_t left(std::size_t i) const {return i - 1;}
+  std::size_t right(std::size_t i) const {return i + 1;}
+  std::size_t up(std::size_t i) const {return i - m_stride;}
+  std::size_t down(std::size_t i) const {return i + m_stride;}
+
+private:
+  std::size_t m_width;
+  std::size_t m_height;
+  std::size_t m_stride;
+};
+
+// Square Block x Block tiles stored one after another in row-major tile
+// order, cells row-major inside a tile.  A 16x16 tile of elevation is four
+// cache lines, and a tile of distances is one 2 KB run.  Coordinates carry a
+// one cell guard ring so stepping off a real cell always lands in a tile.
+template <std::size_t Block>
+class blocked_layout {
+  static_assert(Block >= 2 && (Block & (Block - 1)) == 0, "Block must be a power of two");
+
+public:
+  blocked_layout(std::size_t width, std::size_t height):
+    m_tilesX((width + 2 + Block - 1)/Block), m_tilesY((height + 2 + Block - 1)/Block) {
+    for (m_shift = 0; (std::size_t(1) << m_shift) < Block; ++m_shift) {}
+    m_tileOriginX.resize(m_tilesX*m_tilesY);
+    m_tileOriginY.resize(m_tilesX*m_tilesY);
+    for (std::size_t t = 0; t < m_tileOriginX.size(); ++t) {
+      m_tileOriginX[t] = uint32_t((t % m_tilesX)*Block);
+      m_tileOriginY[t] = uint32_t((t / m_tilesX)*Block);
+    }
+  }
+
+  std::size_t size() const {return m_tilesX*m_tilesY*Block*Block;}
+  std::size_t index(std::size_t x, std::size_t y) const {
+    ++x;
+    ++y;
+    return (((y >> m_shift)*m_tilesX + (x >> m_shift)) << (2*m_shift)) +
+           ((y & (Block - 1)) << m_shift) + (x & (Block - 1));
+  }
+  std::size_t x(std::size_t i) const {return m_tileOriginX[i >> (2*m_shift)] + (i & (Block - 1)) - 1;}
+  std::size_t y(std::size_t i) const {
+    return m_tileOriginY[i >> (2*m_shift)] + ((i >> m_shift) & (Block - 1)) - 1;
+  }
+
+  std::size_t left(std::size_t i) const {
+    return (i & (Block - 1)) ? i - 1 : i - Block*Block + (Block - 1);
+  }
+  std::size_t right(std::size_t i) const {
+    return (i & (Block - 1)) != Block - 1 ? i + 1 : i + Block*Block - (Block - 1);
+  }
+  std::size_t up(std::size_t i) const {
+    return (i & ((Block - 1) << m_shift)) ? i - Block
+                                          : i - m_tilesX*Block*Block + (Block - 1)*Block;
+  }
+  std::size_t down(std::size_t i) const {
+    return (i & ((Block - 1) << m_shift)) != ((Block - 1) << m_shift)
+               ? i + Block : i + m_tilesX*Block*Block - (Block - 1)*Block;
+  }
+
+private:
+  std::size_t m_tilesX;
+  std::size_t m_tilesY;
+  std::size_t m_shift;
+  // Map coordinates (guard ring included) of each tile's first cell
+  std::vector<uint32_t> m_tileOriginX;
+  std::vector<uint32_t> m_tileOriginY;
+};
+
+// Z-order (Morton) over the smallest power-of-two square holding the map, x
+// in the even bits and y in the odd bits.  Every aligned 2^k square is one
+// contiguous run, at any k.  Non-square or non-power-of-two maps pay for the
+// padding.  There is no guard ring, because that would double the side of
+// a 2048 map.  Stepping off the map yields the extra padding cell at size() - 1.
+class morton_layout {
+public:
+  morton_layout(std::size_t width, std::size_t height):m_side(1) {
+    while (m_side < std::max(width, height))
+      m_side *= 2;
+    m_lastX = spread(uint32_t(width - 1));
+    m_lastY = spread(uint32_t(height - 1)) << 1;
+    m_cells = m_side*m_side;
+  }
+
+  std::size_t size() const {return m_cells + 1;}
+  std::size_t index(std::size_t x, std::size_t y) const {
+    return spread(uint32_t(x)) | (spread(uint32_t(y)) << 1);
+  }
+  std::size_t x(std::size_t i) const {return compact(uint64_t(i));}
+  std::size_t y(std::size_t i) const {return compact(uint64_t(i) >> 1);}
+
+  std::size_t left(std::size_t i) const {
+    return (i & kEven) ? (((i & kEven) - 1) & kEven) | (i & kOdd) : m_cells;
+  }
+  std::size_t right(std::size_t i) const {
+    return (i & kEven) != m_lastX ? (((i | kOdd) + 1) & kEven) | (i & kOdd) : m_cells;
+  }
+  std::size_t up(std::size_t i) const {
+    return (i & kOdd) ? (((i & kOdd) - 1) & kOdd) | (i & kEven) : m_cells;
+  }
+  std::size_t down(std::size_t i) const {
+    return (i & kOdd) != m_lastY ? (((i | kEven) + 1) & kOdd) | (i & kEven) : m_cells;
+  }
+
+private:
+  static const std::size_t kEven = std::size_t(0x5555555555555555ull);
+  static const std::size_t kOdd = std::size_t(0xAAAAAAAAAAAAAAAAull);
+
+  static std::size_t spread(uint32_t v) {
+#if defined(__BMI2__)
+    return std::size_t(_pdep_u64(v, 0x5555555555555555ull));
+#else
+    uint64_t x = v;
+    x = (x | (x << 16)) & 0x0000FFFF0000FFFFull;
+    x = (x | (x << 8)) & 0x00FF00FF00FF00FFull;
+    x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0Full;
+    x = (x | (x << 2)) & 0x3333333333333333ull;
+    x = (x | (x << 1)) & 0x5555555555555555ull;
+    return std::size_t(x);
+#endif
+  }
+  static std::size_t compact(uint64_t x) {
+#if defined(__BMI2__)
+    return std::size_t(_pext_u64(x, 0x5555555555555555ull));
+#else
+    x &= 0x5555555555555555ull;
+    x = (x | (x >> 1)) & 0x3333333333333333ull;
+    x = (x | (x >> 2)) & 0x0F0F0F0F0F0F0F0Full;
+    x = (x | (x >> 4)) & 0x00FF00FF00FF00FFull;
+    x = (x | (x >> 8)) & 0x0000FFFF0000FFFFull;
+    x = (x | (x >> 16)) & 0x00000000FFFFFFFFull;
+    return std::size_t(x);
+#endif
+  }
+
+  std::size_t m_side;
+  std::size_t m_cells;
+  // Morton bits of the last column and row
+  std::size_t m_lastX;
+  std::size_t m_lastY;
+};
+
+// The elevation and barriers of a maze re-laid in the given layout.
+//
+// It offers the same cell interface as maze (index, cell, num_cells,
+// passable, stepCost, for_each_neighbour), so searches written against that
+// interface run on either.  Search state sized by num_cells() then follows
+// the same layout.
+template <typename Layout>
+class layout_grid {
+public:
+  explicit layout_grid(const maze& m):
+    m_width(m.length(0)), m_height(m.length(1)), m_layout(m_width, m_height) {
+    m_elev.assign(m_layout.size(), 0);
+    m_passable.assign(m_layout.size(), 0);
+    for (std::size_t y = 0; y < m_height; ++y)
+      for (std::size_t x = 0; x < m_width; ++x) {
+        std::size_t from = x + y*m_width;
+        std::size_t to = m_layout.index(x, y);
+        m_elev[to] = m.m_elev[from];
+        m_passable[to] = m.passable(from);
+      }
+  }
+
+  vertices_size_type length(std::size_t d) const {return d == 0 ? m_width : m_height;}
+  const Layout& layout() const {return m_layout;}
+
+  std::size_t index(vertex_descriptor u) const {return m_layout.index(u[0], u[1]);}
+  vertex_descriptor cell(std::size_t i) const {
+    vertex_descriptor u = {{m_layout.x(i), m_layout.y(i)}};
+    return u;
+  }
+  std::size_t num_cells() const {return m_layout.size();}
+  bool passable(std::size_t i) const {return m_passable[i] != 0;}
+
+  double stepCost(std::size_t source, std::size_t target) const {
+    return stepTime(int(m_elev[target]) - int(m_elev[source]));
+  }
+
+  template <typename F>
+  void for_each_neighbour(std::size_t i, F f) const {
+    std::size_t n;
+    if (passable(n = m_layout.left(i))) f(n);
+    if (passable(n = m_layout.right(i))) f(n);
+    if (passable(n = m_layout.up(i))) f(n);
+    if (passable(n = m_layout.down(i))) f(n);
+  }
+
+  template <typename F>
+  void for_each_edge(std::size_t i, F f) const {
+    for_each_neighbour(i, [&](std::size_t n) {f(n, stepCost(i, n));});
+  }
+
+private:
+  std::size_t m_width;
+  std::size_t m_height;
+  Layout m_layout;
+  cell_vector<uint8_t> m_elev;
+  cell_vector<uint8_t> m_passable;
+};
+
+// A* with the Manhattan heuristic over any grid with the maze cell
+// interface (maze, layout_grid, compact_graph).  Returns true and sets length
+// if goal is reachable.  The path can be read back with
+// scratch.path(grid, ...).  If expansions is given, it receives the number of
+// cells expanded.
+template <typename Grid>
+bool grid_astar(const Grid& grid, vertex_descriptor source, vertex_descriptor goal,
+                search_scratch& scratch, distance& length, std::size_t* expansions = nullptr) {
+  const std::size_t src = grid.index(source);
+  const std::size_t dst = grid.index(goal);
+  std::size_t expanded = 0;
+  scratch.reset(grid.num_cells());
+  if (!grid.passable(src) || !grid.passable(dst))
+    return false;
+
+  auto heuristic = [&](std::size_t i) {
+    vertex_descriptor u = grid.cell(i);
+    return double(std::abs(long(u[0]) - long(goal[0])) + std::abs(long(u[1]) - long(goal[1])));
+  };
+  open_list open;
+  scratch.set(src, 0, src);
+  open.push(open_entry(heuristic(src), uint32_t(src)));
+  while (!open.empty()) {
+    std::size_t u = open.top().second;
+    open.pop();
+    if (scratch.closed(u))
+      continue;
+    scratch.close(u);
+    ++expanded;
+    if (u == dst)
+      break;
+    const distance gu = scratch.dist(u);
+    grid.for_each_edge(u, [&](std::size_t v, double w) {
+      distance d = gu + w;
+      if (d < scratch.dist(v)) {
+        scratch.set(v, d, u);
+        open.push(open_entry(d + heuristic(v), uint32_t(v)));
+      }
+    });
+  }
+  if (expansions)
+    *expansions = expanded;
+  if (!scratch.closed(dst))
+    return false;
+  length = scratch.dist(dst);
+  return true;
+}
+
+#endif
@@ -0,0 +1,293 @@
+#ifndef CELL_MEMORY_HPP
+#define CELL_MEMORY_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <dirent.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define CELL_MEMORY_HAS_MMAP
+#endif
+
+#include "parallel.hpp"
+
+// Allocation of large per-cell arrays.
+//
+// Searches touch per-cell planes in an almost random order.  With 4 KB pages
+// a 2048x2048 distance plane covers 8192 pages, far more than the TLB holds.
+// Buffers of at least kHugePageBytes are therefore mapped directly and
+// aligned to 2 MB.  They can use explicit huge pages from the kernel's
+// reserved pool, or be marked for transparent huge pages.  If the pool is
+// empty the allocator falls back to transparent huge pages, and if those are
+// unavailable it keeps the plain mapping.  Smaller buffers come from
+// operator new.
+//
+// Linux places a page on the NUMA node of the thread that first writes it.
+// With touch_threads > 1 the pages of a new buffer are first written by that
+// many threads in contiguous slices, so a multi-threaded query that splits
+// the map the same way (parallel_for) mostly reads local memory.  The threads
+// are not pinned, so the spread follows wherever the scheduler put them.
+
+const std::size_t kHugePageBytes = std::size_t(1) << 21;
+
+struct cell_memory_policy {
+  // Ask for transparent huge pages with madvise(MADV_HUGEPAGE)
+  bool transparent_huge_pages = true;
+  // Try MAP_HUGETLB first; needs pages reserved in /proc/sys/vm/nr_hugepages
+  bool explicit_huge_pages = false;
+  // Threads writing the first touch of each new mapped buffer
+  unsigned touch_threads = 1;
+};
+
+// What the allocator actually got, in bytes of live buffers.
+struct cell_memory_report {
+  std::size_t explicit_huge_bytes;
+  std::size_t transparent_huge_bytes;
+  std::size_t small_page_bytes;
+  std::size_t heap_bytes;
+  // Explicit huge page requests that fell back to transparent ones
+  std::size_t explicit_fallbacks;
+  // Transparent huge page hints the kernel refused
+  std::size_t transparent_fallbacks;
+  // Huge pages the kernel reports backing anonymous memory, -1 if unknown
+  long anon_huge_bytes;
+  unsigned numa_nodes;
+};
+
+namespace detail {
+
+struct cell_memory_state {
+  cell_memory_policy policy;
+  std::atomic<std::size_t> explicitHuge{0};
+  std::atomic<std::size_t> transparentHuge{0};
+  std::atomic<std::size_t> smallPage{0};
+  std::atomic<std::size_t> heap{0};
+  std::atomic<std::size_t> explicitFallbacks{0};
+  std::atomic<std::size_t> transparentFallbacks{0};
+};
+
+inline cell_memory_state& cellMemoryState() {
+  static cell_memory_state state;
+  return state;
+}
+
+// How a mapped buffer is backed.
+enum cell_mapping {CM_EXPLICIT = 1, CM_TRANSPARENT = 2, CM_SMALL = 3};
+
+inline std::size_t roundToHugePage(std::size_t bytes) {
+  return (bytes + kHugePageBytes - 1) & ~(kHugePageBytes - 1);
+}
+
+#ifdef CELL_MEMORY_HAS_MMAP
+// Map bytes (a multiple of kHugePageBytes) aligned to kHugePageBytes.
+inline void* mapAligned(std::size_t bytes, int& kind) {
+  cell_memory_state& state = cellMemoryState();
+#ifdef MAP_HUGETLB
+  if (state.policy.explicit_huge_pages) {
+    void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+      kind = CM_EXPLICIT;
+      return p;
+    }
+    ++state.explicitFallbacks;
+  }
+#endif
+  // Over-map by one huge page and trim both ends to get the alignment.
+  void* raw = mmap(nullptr, bytes + kHugePageBytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (raw == MAP_FAILED)
+    return nullptr;
+  uintptr_t begin = reinterpret_cast<uintptr_t>(raw);
+  uintptr_t aligned = (begin + kHugePageBytes - 1) & ~uintptr_t(kHugePageBytes - 1);
+  if (aligned > begin)
+    munmap(raw, aligned - begin);
+  if (aligned + bytes < begin + bytes + kHugePageBytes)
+    munmap(reinterpret_cast<void*>(aligned + bytes), begin + kHugePageBytes - aligned);
+  void* p = reinterpret_cast<void*>(aligned);
+
+  kind = CM_SMALL;
+#ifdef MADV_HUGEPAGE
+  if (state.policy.transparent_huge_pages) {
+    if (madvise(p, bytes, MADV_HUGEPAGE) == 0)
+      kind = CM_TRANSPARENT;
+    else
+      ++state.transparentFallbacks;
+  }
+#endif
+  return p;
+}
+#endif
+
+// Write one byte per page, in touch_threads contiguous slices.
+inline void firstTouch(void* p, std::size_t bytes, unsigned threads) {
+  if (threads <= 1)
+    return;
+  const std::size_t page = 4096;
+  char* base = static_cast<char*>(p);
+  parallel_for(0, bytes/page, threads, [&](std::size_t first, std::size_t last, unsigned) {
+    for (std::size_t i = first; i < last; ++i)
+      base[i*page] = 0;
+  });
+}
+
+inline std::atomic<std::size_t>& counterFor(int kind) {
+  cell_memory_state& state = cellMemoryState();
+  return kind == CM_EXPLICIT ? state.explicitHuge : kind == CM_TRANSPARENT ? state.transparentHuge
+                                                                            : state.smallPage;
+}
+
+// Backing of every live mapped buffer, so that deallocate can update the
+// right counter.  There are only ever a handful of these.
+class mapping_registry {
+public:
+  void add(void* p, int kind) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.push_back(std::make_pair(p, kind));
+  }
+  int remove(void* p) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (std::size_t i = 0; i < m_entries.size(); ++i)
+      if (m_entries[i].first == p) {
+        int kind = m_entries[i].second;
+        m_entries[i] = m_entries.back();
+        m_entries.pop_back();
+        return kind;
+      }
+    return 0;
+  }
+
+private:
+  std::mutex m_mutex;
+  std::vector<std::pair<void*, int> > m_entries;
+};
+
+inline mapping_registry& mappings() {
+  static mapping_registry registry;
+  return registry;
+}
+
+} // namespace detail
+
+// Replace the policy for buffers allocated from now on.
+inline void set_cell_memory_policy(const cell_memory_policy& policy) {
+  detail::cellMemoryState().policy = policy;
+}
+
+inline cell_memory_policy get_cell_memory_policy() {
+  return detail::cellMemoryState().policy;
+}
+
+inline cell_memory_report cell_memory_usage() {
+  detail::cell_memory_state& state = detail::cellMemoryState();
+  cell_memory_report report;
+  report.explicit_huge_bytes = state.explicitHuge;
+  report.transparent_huge_bytes = state.transparentHuge;
+  report.small_page_bytes = state.smallPage;
+  report.heap_bytes = state.heap;
+  report.explicit_fallbacks = state.explicitFallbacks;
+  report.transparent_fallbacks = state.transparentFallbacks;
+  report.anon_huge_bytes = -1;
+  report.numa_nodes = 1;
+#ifdef CELL_MEMORY_HAS_MMAP
+  std::ifstream smaps("/proc/self/smaps_rollup");
+  std::string key;
+  long value;
+  while (smaps >> key) {
+    if (key == "AnonHugePages:" && smaps >> value) {
+      report.anon_huge_bytes = value*1024;
+      break;
+    }
+    smaps.ignore(1 << 10, '\n');
+  }
+  if (DIR* nodes = opendir("/sys/devices/system/node")) {
+    unsigned count = 0;
+    while (dirent* entry = readdir(nodes))
+      if (std::string(entry->d_name).compare(0, 4, "node") == 0 &&
+          entry->d_name[4] >= '0' && entry->d_name[4] <= '9')
+        ++count;
+    closedir(nodes);
+    if (count > 0)
+      report.numa_nodes = count;
+  }
+#endif
+  return report;
+}
+
+inline std::ostream& operator<<(std::ostream& out, const cell_memory_report& r) {
+  const double mb = 1 << 20;
+  out << "cell buffers: " << r.explicit_huge_bytes/mb << " MB explicit huge pages, "
+      << r.transparent_huge_bytes/mb << " MB transparent huge pages requested, "
+      << r.small_page_bytes/mb << " MB small pages, " << r.heap_bytes/mb << " MB heap";
+  if (r.explicit_fallbacks || r.transparent_fallbacks)
+    out << " (" << r.explicit_fallbacks << " explicit and " << r.transparent_fallbacks
+        << " transparent huge page requests fell back)";
+  if (r.anon_huge_bytes >= 0)
+    out << "; kernel reports " << r.anon_huge_bytes/mb << " MB in huge pages";
+  out << "; " << r.numa_nodes << " NUMA node" << (r.numa_nodes == 1 ? "" : "s");
+  return out;
+}
+
+// Standard allocator following the policy above.
+template <typename T>
+class cell_allocator {
+public:
+  typedef T value_type;
+
+  cell_allocator() {}
+  template <typename U>
+  cell_allocator(const cell_allocator<U>&) {}
+
+  T* allocate(std::size_t n) {
+    const std::size_t bytes = n*sizeof(T);
+#ifdef CELL_MEMORY_HAS_MMAP
+    if (bytes >= kHugePageBytes) {
+      const std::size_t mapped = detail::roundToHugePage(bytes);
+      int kind;
+      void* p = detail::mapAligned(mapped, kind);
+      if (!p)
+        throw std::bad_alloc();
+      detail::firstTouch(p, mapped, detail::cellMemoryState().policy.touch_threads);
+      detail::mappings().add(p, kind);
+      detail::counterFor(kind) += mapped;
+      return static_cast<T*>(p);
+    }
+#endif
+    detail::cellMemoryState().heap += bytes;
+    return static_cast<T*>(::operator new(bytes));
+  }
+
+  void deallocate(T* p, std::size_t n) {
+    const std::size_t bytes = n*sizeof(T);
+#ifdef CELL_MEMORY_HAS_MMAP
+    if (bytes >= kHugePageBytes) {
+      const std::size_t mapped = detail::roundToHugePage(bytes);
+      detail::counterFor(detail::mappings().remove(p)) -= mapped;
+      munmap(p, mapped);
+      return;
+    }
+#endif
+    detail::cellMemoryState().heap -= bytes;
+    ::operator delete(p);
+  }
+};
+
+template <typename T, typename U>
+bool operator==(const cell_allocator<T>&, const cell_allocator<U>&) {return true;}
+template <typename T, typename U>
+bool operator!=(const cell_allocator<T>&, const cell_allocator<U>&) {return false;}
+
+// A per-cell plane allocated with cell_allocator.
+template <typename T>
+using cell_vector = std::vector<T, cell_allocator<T> >;
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef COMPACT_INDEX_HPP
+#define COMPACT_INDEX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "cell_memory.hpp"
+#include "map_build.hpp"
+#include "parallel.hpp"
+#include "utility.hpp"
+
+// Numbering of the traversable cells only.
+//
+// Half of the island is water, so arrays indexed by maze cell spend half
+// their memory on cells a search never touches.  compact_index gives the
+// traversable cells dense ids 0..size()-1 in row-major order.  id(cell) is
+// the rank of the cell in the passable bitmap: a per-word running count plus
+// a popcount inside the word.  cell(id) is the select, read from a table.
+// Both are O(1).
+class compact_index {
+public:
+  compact_index():m_bits(nullptr) {};
+
+  // The maze must outlive the index.
+  explicit compact_index(const maze& m, unsigned threads = default_threads()):m_bits(&m.m_passable[0]) {
+    const std::size_t cells = m.num_cells();
+    const std::size_t words = (cells + 63)/64;
+    const uint64_t* bits = m_bits;
+    m_rank.resize(words + 1);
+    uint32_t total = 0;
+    for (std::size_t w = 0; w < words; ++w) {
+      m_rank[w] = total;
+      total += detail::popcount64(bits[w]);
+    }
+    m_rank[words] = total;
+    m_cell.resize(total);
+    parallel_for(0, words, threads, [&](std::size_t first, std::size_t last, unsigned) {
+      for (std::size_t w = first; w < last; ++w) {
+        uint32_t id = m_rank[w];
+        for (uint64_t b = bits[w]; b; b &= b - 1)
+          m_cell[id++] = uint32_t(w*64 + detail::lowestBit64(b));
+      }
+    });
+  }
+
+  // Number of traversable cells
+  std::size_t size() const {return m_cell.size();}
+  // Id of a traversable maze cell.  For a barrier cell this is the id of the
+  // next traversable cell, so check maze::passable first.
+  uint32_t id(std::size_t cell) const {
+    const uint64_t below = (uint64_t(1) << (cell & 63)) - 1;
+    return m_rank[cell >> 6] + detail::popcount64(m_bits[cell >> 6] & below);
+  }
+  // Maze cell of an id
+  std::size_t cell(uint32_t id) const {return m_cell[id];}
+
+  std::size_t memory_bytes() const {
+    return m_rank.size()*sizeof(uint32_t) + m_cell.size()*sizeof(uint32_t);
+  }
+
+private:
+  // The maze's passable bitmap
+  const uint64_t* m_bits;
+  // Traversable cells before each bitmap word, plus the total
+  cell_vector<uint32_t> m_rank;
+  // Maze cell of every id
+  cell_vector<uint32_t> m_cell;
+};
+
+// The traversable cells of a maze as a graph over compact ids.
+//
+// It offers the maze cell interface over compact ids (index, cell,
+// num_cells, passable, stepCost, for_each_neighbour, for_each_edge), so
+// grid_astar and search_scratch work on it unchanged, with search state sized
+// to the traversable cells only.  Nothing per edge is stored.  Ids follow the
+// row-major order, so within a row span of traversable cells the west and
+// east neighbours of id are id - 1 and id + 1.  The north and south
+// neighbours are one rank away.  Costs come from the maze's edge planes.
+class compact_graph {
+public:
+  // The maze must outlive the graph.
+  explicit compact_graph(const maze& m, unsigned threads = default_threads()):
+    m_maze(m), m_index(m, threads), m_width(m.length(0)) {}
+
+  const compact_index& cells() const {return m_index;}
+  vertices_size_type length(std::size_t d) const {return m_maze.length(d);}
+
+  // Compact id of a cell; barriers all map to no_cell().
+  std::size_t index(vertex_descriptor u) const {
+    std::size_t i = m_maze.index(u);
+    return m_maze.passable(i) ? m_index.id(i) : no_cell();
+  }
+  // An isolated placeholder vertex one past the real ids
+  std::size_t no_cell() const {return m_index.size();}
+  vertex_descriptor cell(std::size_t id) const {return m_maze.cell(m_index.cell(uint32_t(id)));}
+  std::size_t num_cells() const {return m_index.size() + 1;}
+  bool passable(std::size_t id) const {return id != no_cell();}
+
+  double stepCost(std::size_t source, std::size_t target) const {
+    return m_maze.stepCost(m_index.cell(uint32_t(source)), m_index.cell(uint32_t(target)));
+  }
+
+  template <typename F>
+  void for_each_neighbour(std::size_t id, F f) const {
+    for_each_edge(id, [&](std::size_t n, float) {f(n);});
+  }
+
+  // Same order as maze::for_each_edge: west, east, north, south.
+  template <typename F>
+  void for_each_edge(std::size_t id, F f) const {
+    if (id == no_cell())
+      return;
+    const std::size_t i = m_index.cell(uint32_t(id));
+    const float* east = &m_maze.m_costs.east[0];
+    const float* south = &m_maze.m_costs.south[0];
+    float c;
+    if (i > 0 && (c = east[i - 1]) != kBarrierCost) f(id - 1, c);
+    if ((c = east[i]) != kBarrierCost) f(id + 1, c);
+    if (i >= m_width && (c = south[i - m_width]) != kBarrierCost) f(std::size_t(m_index.id(i - m_width)), c);
+    if ((c = south[i]) != kBarrierCost) f(std::size_t(m_index.id(i + m_width)), c);
+  }
+
+  std::size_t memory_bytes() const {return m_index.memory_bytes();}
+
+private:
+  const maze& m_maze;
+  compact_index m_index;
+  std::size_t m_width;
+};
+
+#endif
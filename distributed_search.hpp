@@ -0,0 +1,450 @@
+#ifndef DISTRIBUTED_SEARCH_HPP
+#define DISTRIBUTED_SEARCH_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define DISTRIBUTED_SEARCH_SUPPORTED
+#endif
+
+#include "tiled_map.hpp"
+#include "utility.hpp"
+
+// Partitioned A* across processes.
+//
+// The map is cut into horizontal strips, each owned by a solver process that
+// only ever loads its own rows (plus one halo row on each side) from a tiled
+// map file.  A coordinator drives the search in rounds.  Every round it tells
+// each partition the best known goal distance and a horizon on f = g + h, and
+// forwards the distance updates that other partitions produced for cells the
+// partition owns.  Each partition then runs its A* open list up to the
+// horizon and reports its own boundary updates, its smallest open key and, if
+// it owns the goal, the goal's tentative distance.  The search ends once no
+// updates are in flight and no open key is below the goal distance.
+// Partitions re-expand cells whose distance improves later, so the result is
+// optimal regardless of the order in which updates arrive.
+//
+// Workers talk to the coordinator over a stream socket each.  Here they are
+// forked processes on one host connected by socket pairs; the protocol only
+// needs a byte stream, so remote workers can be attached the same way later.
+
+struct distributed_options {
+  // Number of worker processes (strips)
+  unsigned partitions = 4;
+  // How far past the smallest open key a round may expand, in island seconds
+  double window = 64;
+  // Tiles each worker keeps mapped
+  std::size_t resident_tiles = 64;
+};
+
+struct distributed_stats {
+  std::size_t rounds;
+  std::size_t updates;
+  std::size_t expansions;
+};
+
+namespace detail {
+
+enum distributed_message {
+  DM_ROUND = 1,     // coordinator -> worker: bound, horizon, updates
+  DM_REPORT = 2,    // worker -> coordinator: goal distance, min key, expansions, updates
+  DM_TRACE = 3,     // coordinator -> worker: cell to trace back from
+  DM_PATH = 4,      // worker -> coordinator: cells, next cell or source marker
+  DM_QUIT = 5
+};
+
+// A distance offered to a cell by a neighbour in another partition.
+struct boundary_update {
+  uint64_t cell;
+  distance dist;
+  uint64_t from;
+};
+
+// A peer that has gone away makes this return false (EPIPE) rather than
+// raise SIGPIPE, which would kill the coordinator.
+inline bool writeAll(int fd, const void* data, std::size_t bytes) {
+#ifdef DISTRIBUTED_SEARCH_SUPPORTED
+  const char* p = static_cast<const char*>(data);
+  while (bytes > 0) {
+#ifdef MSG_NOSIGNAL
+    ssize_t n = ::send(fd, p, bytes, MSG_NOSIGNAL);
+#else
+    // SO_NOSIGPIPE is set on the socket instead
+    ssize_t n = ::write(fd, p, bytes);
+#endif
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    bytes -= std::size_t(n);
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+inline bool readAll(int fd, void* data, std::size_t bytes) {
+#ifdef DISTRIBUTED_SEARCH_SUPPORTED
+  char* p = static_cast<char*>(data);
+  while (bytes > 0) {
+    ssize_t n = ::read(fd, p, bytes);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    bytes -= std::size_t(n);
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+template <typename T>
+bool sendValue(int fd, const T& value) {return writeAll(fd, &value, sizeof(T));}
+template <typename T>
+bool receiveValue(int fd, T& value) {return readAll(fd, &value, sizeof(T));}
+
+template <typename T>
+bool sendVector(int fd, const std::vector<T>& values) {
+  uint64_t n = values.size();
+  return sendValue(fd, n) && (n == 0 || writeAll(fd, &values[0], n*sizeof(T)));
+}
+template <typename T>
+bool receiveVector(int fd, std::vector<T>& values) {
+  uint64_t n;
+  if (!receiveValue(fd, n))
+    return false;
+  values.resize(std::size_t(n));
+  return n == 0 || readAll(fd, &values[0], std::size_t(n)*sizeof(T));
+}
+
+// The solver process owning rows [m_first, m_last).
+class partition_worker {
+public:
+  partition_worker(tiled_map& map, std::size_t first, std::size_t last,
+                   vertex_descriptor source, vertex_descriptor goal):
+    m_width(map.width()), m_height(map.height()), m_first(first), m_last(last),
+    m_source(source[1]*m_width + source[0]), m_goal(goal[1]*m_width + goal[0]), m_expansions(0) {
+    // Own rows plus one halo row above and below
+    m_haloFirst = first > 0 ? first - 1 : first;
+    std::size_t haloLast = std::min<std::size_t>(last + 1, m_height);
+    m_terrain.resize((haloLast - m_haloFirst)*m_width);
+    for (std::size_t y = m_haloFirst; y < haloLast; ++y)
+      for (std::size_t x = 0; x < m_width; ++x)
+        m_terrain[(y - m_haloFirst)*m_width + x] = map.at(x, y);
+    m_dist.assign((last - first)*m_width, std::numeric_limits<distance>::infinity());
+    m_pred.assign((last - first)*m_width, 0);
+  }
+
+  // Serve the coordinator until it says quit.
+  void run(int fd) {
+    uint32_t type;
+    while (receiveValue(fd, type)) {
+      if (type == DM_ROUND) {
+        double bound, horizon;
+        std::vector<boundary_update> inbox;
+        if (!receiveValue(fd, bound) || !receiveValue(fd, horizon) || !receiveVector(fd, inbox))
+          return;
+        std::vector<boundary_update> outbox;
+        round(bound, horizon, inbox, outbox);
+        uint32_t reply = DM_REPORT;
+        double goalDist = owns(m_goal) ? m_dist[local(m_goal)] : std::numeric_limits<double>::infinity();
+        double minKey = minOpenKey();
+        uint64_t expansions = m_expansions;
+        if (!sendValue(fd, reply) || !sendValue(fd, goalDist) || !sendValue(fd, minKey) ||
+            !sendValue(fd, expansions) || !sendVector(fd, outbox))
+          return;
+      } else if (type == DM_TRACE) {
+        uint64_t cell;
+        if (!receiveValue(fd, cell))
+          return;
+        std::vector<uint64_t> cells;
+        while (true) {
+          cells.push_back(cell);
+          if (cell == m_source)
+            break;
+          cell = m_pred[local(cell)];
+          if (!owns(cell))
+            break;
+        }
+        uint32_t reply = DM_PATH;
+        uint64_t next = cells.back() == m_source ? std::numeric_limits<uint64_t>::max() : cell;
+        if (!sendValue(fd, reply) || !sendVector(fd, cells) || !sendValue(fd, next))
+          return;
+      } else {
+        return;
+      }
+    }
+  }
+
+private:
+  typedef std::pair<double, uint64_t> entry;
+
+  bool owns(uint64_t cell) const {
+    uint64_t y = cell / m_width;
+    return y >= m_first && y < m_last;
+  }
+  std::size_t local(uint64_t cell) const {return std::size_t(cell - m_first*m_width);}
+  int terrain(uint64_t cell) const {return m_terrain[std::size_t(cell - m_haloFirst*m_width)];}
+  double heuristic(uint64_t cell) const {
+    return double(std::abs(long(cell % m_width) - long(m_goal % m_width)) +
+                  std::abs(long(cell / m_width) - long(m_goal / m_width)));
+  }
+
+  double minOpenKey() {
+    while (!m_open.empty() && m_open.top().first != m_dist[local(m_open.top().second)] + heuristic(m_open.top().second))
+      m_open.pop();
+    return m_open.empty() ? std::numeric_limits<double>::infinity() : m_open.top().first;
+  }
+
+  void round(double bound, double horizon, const std::vector<boundary_update>& inbox,
+             std::vector<boundary_update>& outbox) {
+    for (const boundary_update& u : inbox) {
+      std::size_t i = local(u.cell);
+      if (u.dist < m_dist[i]) {
+        m_dist[i] = u.dist;
+        m_pred[i] = u.from;
+        m_open.push(entry(u.dist + heuristic(u.cell), u.cell));
+      }
+    }
+
+    // Best offer per foreign cell this round
+    std::unordered_map<uint64_t, boundary_update> offers;
+    const double limit = std::min(bound, horizon);
+    while (minOpenKey() < limit) {
+      uint64_t u = m_open.top().second;
+      m_open.pop();
+      ++m_expansions;
+      const distance gu = m_dist[local(u)];
+      const int eu = terrain(u);
+      const uint64_t x = u % m_width, y = u / m_width;
+      uint64_t neighbours[4];
+      int count = 0;
+      if (x > 0) neighbours[count++] = u - 1;
+      if (x + 1 < m_width) neighbours[count++] = u + 1;
+      if (y > 0) neighbours[count++] = u - m_width;
+      if (y + 1 < m_height) neighbours[count++] = u + m_width;
+      for (int k = 0; k < count; ++k) {
+        uint64_t v = neighbours[k];
+        int ev = terrain(v);
+        if (ev == 0)
+          continue;
+        distance d = gu + stepTime(ev - eu);
+        if (owns(v)) {
+          if (d < m_dist[local(v)]) {
+            m_dist[local(v)] = d;
+            m_pred[local(v)] = u;
+            m_open.push(entry(d + heuristic(v), v));
+          }
+        } else {
+          auto offer = offers.find(v);
+          if (offer == offers.end() || d < offer->second.dist) {
+            boundary_update update = {v, d, u};
+            offers[v] = update;
+          }
+        }
+      }
+    }
+    outbox.clear();
+    for (const auto& offer : offers)
+      outbox.push_back(offer.second);
+  }
+
+  std::size_t m_width;
+  std::size_t m_height;
+  std::size_t m_first;
+  std::size_t m_last;
+  std::size_t m_haloFirst;
+  uint64_t m_source;
+  uint64_t m_goal;
+  std::vector<uint8_t> m_terrain;
+  std::vector<distance> m_dist;
+  std::vector<uint64_t> m_pred;
+  std::priority_queue<entry, std::vector<entry>, std::greater<entry> > m_open;
+  uint64_t m_expansions;
+};
+
+} // namespace detail
+
+// Shortest path from source to goal over the tiled map at mapPath, solved by
+// options.partitions worker processes.  Returns true and fills path and
+// length if the goal is reachable.
+inline bool distributed_solve(const char* mapPath, vertex_descriptor source, vertex_descriptor goal,
+                              std::vector<vertex_descriptor>& path, distance& length,
+                              const distributed_options& options = distributed_options(),
+                              distributed_stats* stats = nullptr) {
+#ifndef DISTRIBUTED_SEARCH_SUPPORTED
+  return false;
+#else
+  using namespace detail;
+  distributed_stats local = distributed_stats();
+  distributed_stats& st = stats ? *stats : local;
+  st = distributed_stats();
+
+  std::size_t width, height;
+  {
+    tiled_map map(1);
+    if (!map.open(mapPath) || !map.passable(source[0], source[1]) || !map.passable(goal[0], goal[1]))
+      return false;
+    width = map.width();
+    height = map.height();
+  }
+  const unsigned parts = std::max(1u, std::min<unsigned>(options.partitions, unsigned(height)));
+  std::vector<std::size_t> rows(parts + 1);
+  for (unsigned p = 0; p <= parts; ++p)
+    rows[p] = height*p/parts;
+  auto owner = [&](uint64_t cell) {
+    std::size_t y = std::size_t(cell / width);
+    return unsigned(std::upper_bound(rows.begin(), rows.end(), y) - rows.begin() - 1);
+  };
+
+  std::vector<int> fds(parts);
+  std::vector<pid_t> pids(parts);
+  // Tell the first count workers to quit and wait for them
+  auto stopWorkers = [&](unsigned count) {
+    for (unsigned p = 0; p < count; ++p) {
+      uint32_t type = DM_QUIT;
+      sendValue(fds[p], type);
+      ::close(fds[p]);
+      waitpid(pids[p], nullptr, 0);
+    }
+  };
+  for (unsigned p = 0; p < parts; ++p) {
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+      stopWorkers(p);
+      throw std::exception();
+    }
+#if !defined(MSG_NOSIGNAL) && defined(SO_NOSIGPIPE)
+    int on = 1;
+    setsockopt(pair[0], SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+    setsockopt(pair[1], SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+    pid_t pid = fork();
+    if (pid == 0) {
+      ::close(pair[0]);
+      for (unsigned q = 0; q < p; ++q)
+        ::close(fds[q]);
+      tiled_map map(options.resident_tiles);
+      if (map.open(mapPath)) {
+        partition_worker worker(map, rows[p], rows[p + 1], source, goal);
+        map.close();
+        worker.run(pair[1]);
+      }
+      _exit(0);
+    }
+    if (pid < 0) {
+      ::close(pair[0]);
+      ::close(pair[1]);
+      stopWorkers(p);
+      throw std::exception();
+    }
+    ::close(pair[1]);
+    fds[p] = pair[0];
+    pids[p] = pid;
+  }
+
+  auto heuristic = [&](uint64_t cell) {
+    return double(std::abs(long(cell % width) - long(goal[0])) +
+                  std::abs(long(cell / width) - long(goal[1])));
+  };
+  const uint64_t src = source[1]*width + source[0];
+  const uint64_t dst = goal[1]*width + goal[0];
+
+  std::vector<std::vector<boundary_update> > inbox(parts);
+  boundary_update start = {src, 0, src};
+  inbox[owner(src)].push_back(start);
+  std::vector<double> minKeys(parts, std::numeric_limits<double>::infinity());
+  double bound = std::numeric_limits<double>::infinity();
+  bool ok = true;
+
+  while (ok) {
+    // Lowest key anywhere, open or in flight, sets this round's horizon.
+    double lowest = *std::min_element(minKeys.begin(), minKeys.end());
+    bool inFlight = false;
+    for (const auto& updates : inbox)
+      for (const boundary_update& u : updates) {
+        lowest = std::min(lowest, u.dist + heuristic(u.cell));
+        inFlight = true;
+      }
+    if (!(lowest < bound) || (!inFlight && lowest == std::numeric_limits<double>::infinity()))
+      break;
+    const double horizon = lowest + options.window;
+
+    ++st.rounds;
+    for (unsigned p = 0; p < parts && ok; ++p) {
+      uint32_t type = DM_ROUND;
+      ok = sendValue(fds[p], type) && sendValue(fds[p], bound) && sendValue(fds[p], horizon) &&
+           sendVector(fds[p], inbox[p]);
+      inbox[p].clear();
+    }
+    st.expansions = 0;
+    for (unsigned p = 0; p < parts && ok; ++p) {
+      uint32_t type = 0;
+      double goalDist = std::numeric_limits<double>::infinity();
+      uint64_t expansions = 0;
+      std::vector<boundary_update> outbox;
+      ok = receiveValue(fds[p], type) && type == DM_REPORT && receiveValue(fds[p], goalDist) &&
+           receiveValue(fds[p], minKeys[p]) && receiveValue(fds[p], expansions) &&
+           receiveVector(fds[p], outbox);
+      if (!ok)
+        break;
+      bound = std::min(bound, goalDist);
+      st.expansions += std::size_t(expansions);
+      st.updates += outbox.size();
+      for (const boundary_update& u : outbox)
+        inbox[owner(u.cell)].push_back(u);
+    }
+  }
+
+  bool found = ok && bound < std::numeric_limits<double>::infinity();
+  if (found) {
+    // Follow the predecessor chain back through the partitions.
+    std::vector<uint64_t> cells;
+    uint64_t cell = dst;
+    while (ok) {
+      unsigned p = owner(cell);
+      uint32_t type = DM_TRACE;
+      std::vector<uint64_t> part;
+      uint64_t next = std::numeric_limits<uint64_t>::max();
+      ok = sendValue(fds[p], type) && sendValue(fds[p], cell) && receiveValue(fds[p], type) &&
+           type == DM_PATH && receiveVector(fds[p], part) && receiveValue(fds[p], next);
+      if (!ok)
+        break;
+      cells.insert(cells.end(), part.begin(), part.end());
+      if (next == std::numeric_limits<uint64_t>::max())
+        break;
+      cell = next;
+    }
+    path.clear();
+    for (auto c = cells.rbegin(); c != cells.rend(); ++c) {
+      vertex_descriptor v = {{std::size_t(*c % width), std::size_t(*c / width)}};
+      path.push_back(v);
+    }
+    length = bound;
+    found = ok;
+  }
+
+  stopWorkers(parts);
+  return found;
+#endif
+}
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef EDGE_COSTS_HPP
+#define EDGE_COSTS_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "cell_memory.hpp"
+#include "parallel.hpp"
+
+// Precomputed travel times of every grid edge.
+//
+// Each plane holds, at cell i, the cost of the edge from i towards one
+// direction: east (i + 1), south (i + w) and, when built with diagonals,
+// south-east (i + w + 1) and south-west (i + w - 1).  Costs are symmetric, so
+// the edge to the west of i is east[i - 1] and so on.  An edge that leaves
+// the map or touches an impassable cell costs infinity.  A search therefore
+// reads one float per neighbour and never looks at elevations.
+struct edge_cost_planes {
+  cell_vector<float> east;
+  cell_vector<float> south;
+  // Empty unless built with diagonals
+  cell_vector<float> south_east;
+  cell_vector<float> south_west;
+};
+
+const float kBarrierCost = std::numeric_limits<float>::infinity();
+
+namespace detail {
+
+// cost[x] = passable(a[x]) && passable(b[x]) ? table[|ea[x] - eb[x]|] : inf
+// for x in [0, n).  ea/pa are the source cells, eb/pb the targets.
+inline void edgeCostRow(float* cost, const uint8_t* ea, const uint8_t* eb,
+                        const uint8_t* pa, const uint8_t* pb, std::size_t n, const float* table) {
+  std::size_t x = 0;
+#if defined(__AVX2__)
+  const __m256 barrier = _mm256_set1_ps(kBarrierCost);
+  for (; x + 8 <= n; x += 8) {
+    __m256i a = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(ea + x)));
+    __m256i b = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(eb + x)));
+    __m256i both = _mm256_cvtepu8_epi32(_mm_and_si128(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pa + x)),
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pb + x))));
+    __m256 c = _mm256_i32gather_ps(table, _mm256_abs_epi32(_mm256_sub_epi32(a, b)), 4);
+    __m256 blocked = _mm256_castsi256_ps(_mm256_cmpeq_epi32(both, _mm256_setzero_si256()));
+    _mm256_storeu_ps(cost + x, _mm256_blendv_ps(c, barrier, blocked));
+  }
+#elif defined(__SSE2__)
+  // No gather before AVX2: take |delta| and the barrier mask sixteen cells at
+  // a time, then look the costs up.
+  const __m128i zero = _mm_setzero_si128();
+  alignas(16) uint8_t delta[16], blocked[16];
+  for (; x + 16 <= n; x += 16) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ea + x));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(eb + x));
+    __m128i both = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pa + x)),
+                                 _mm_loadu_si128(reinterpret_cast<const __m128i*>(pb + x)));
+    _mm_store_si128(reinterpret_cast<__m128i*>(delta), _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a)));
+    _mm_store_si128(reinterpret_cast<__m128i*>(blocked), _mm_cmpeq_epi8(both, zero));
+    for (int k = 0; k < 16; ++k)
+      cost[x + k] = blocked[k] ? kBarrierCost : table[delta[k]];
+  }
+#endif
+  for (; x < n; ++x)
+    cost[x] = (pa[x] && pb[x]) ? table[std::abs(int(ea[x]) - int(eb[x]))] : kBarrierCost;
+}
+
+} // namespace detail
+
+// Fill row y of planes for a w-wide raster.  elev/pass are the elevation
+// and passable bytes of row y, below/passBelow those of row y + 1, or null
+// if y is the last row.  straight and diagonal are 256-entry tables of step
+// cost by absolute elevation difference; diagonal is null when the planes
+// have no diagonals.  The planes must already be sized.
+inline void build_edge_cost_row(edge_cost_planes& planes, std::size_t y, std::size_t w,
+                                const uint8_t* elev, const uint8_t* pass,
+                                const uint8_t* below, const uint8_t* passBelow,
+                                const float* straight, const float* diagonal) {
+  const std::size_t row = y*w;
+  detail::edgeCostRow(&planes.east[row], elev, elev + 1, pass, pass + 1, w - 1, straight);
+  planes.east[row + w - 1] = kBarrierCost;
+  if (!below) {
+    std::fill(&planes.south[row], &planes.south[row] + w, kBarrierCost);
+    if (diagonal) {
+      std::fill(&planes.south_east[row], &planes.south_east[row] + w, kBarrierCost);
+      std::fill(&planes.south_west[row], &planes.south_west[row] + w, kBarrierCost);
+    }
+    return;
+  }
+  detail::edgeCostRow(&planes.south[row], elev, below, pass, passBelow, w, straight);
+  if (diagonal) {
+    detail::edgeCostRow(&planes.south_east[row], elev, below + 1, pass, passBelow + 1, w - 1, diagonal);
+    planes.south_east[row + w - 1] = kBarrierCost;
+    planes.south_west[row] = kBarrierCost;
+    detail::edgeCostRow(&planes.south_west[row + 1], elev + 1, below, pass + 1, passBelow, w - 1, diagonal);
+  }
+}
+
+// Size planes for a w x h raster and fill every row, split across threads.
+// passable holds one non-zero byte per traversable cell.
+template <typename Bytes>
+void build_edge_cost_planes(const Bytes& elevation, const Bytes& passable, std::size_t w, std::size_t h,
+                            const float* straight, const float* diagonal, edge_cost_planes& planes,
+                            unsigned threads = 1) {
+  const std::size_t cells = w*h;
+  planes.east.resize(cells);
+  planes.south.resize(cells);
+  planes.south_east.resize(diagonal ? cells : 0);
+  planes.south_west.resize(diagonal ? cells : 0);
+  const uint8_t* e = &elevation[0];
+  const uint8_t* p = &passable[0];
+
+  parallel_for(0, h, threads, [&](std::size_t first, std::size_t last, unsigned) {
+    for (std::size_t y = first; y < last; ++y) {
+      const bool lastRow = y + 1 == h;
+      build_edge_cost_row(planes, y, w, e + y*w, p + y*w, lastRow ? nullptr : e + (y + 1)*w,
+                          lastRow ? nullptr : p + (y + 1)*w, straight, diagonal);
+    }
+  });
+}
+
+#endif
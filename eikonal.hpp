@@ -0,0 +1,250 @@
+#ifndef EIKONAL_HPP
+#define EIKONAL_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "free_spans.hpp"
+#include "parallel.hpp"
+#include "search_scratch.hpp"
+#include "utility.hpp"
+
+// Travel-time fields from a destination to every cell.
+//
+// The field T solves the eikonal equation |grad T| = f, where the slowness f
+// of a cell is the rover's time per cell on the local slope: the slope model
+// of timeWeight applied to the elevation gradient (central differences, in
+// elevation steps per cell).  Barriers have infinite slowness.  Because the
+// slope is taken as isotropic the field is a smooth approximation of the grid
+// travel time rather than an exact shortest-path distance.
+
+typedef cell_vector<float> time_field;
+
+const float kInfiniteTime = std::numeric_limits<float>::infinity();
+
+// Per-cell slowness derived from the rover model.
+inline std::vector<float> slownessField(const maze& m) {
+  const std::size_t w = m.length(0), h = m.length(1);
+  std::vector<float> f(m.num_cells(), kInfiniteTime);
+  for (std::size_t y = 0; y < h; ++y)
+    for (std::size_t x = 0; x < w; ++x) {
+      std::size_t i = x + y*w;
+      if (!m.passable(i))
+        continue;
+      auto elev = [&](std::size_t j) {return m.passable(j) ? double(m.m_elev[j]) : double(m.m_elev[i]);};
+      double gx = (elev(x + 1 < w ? i + 1 : i) - elev(x > 0 ? i - 1 : i))/2;
+      double gy = (elev(y + 1 < h ? i + w : i) - elev(y > 0 ? i - w : i))/2;
+      f[i] = float(slopeTime(1, std::sqrt(gx*gx + gy*gy)));
+    }
+  return f;
+}
+
+// First-order Godunov update from the smallest horizontal neighbour a and the
+// smallest vertical neighbour b.
+inline float eikonalUpdate(float a, float b, float f) {
+  if (!(std::fabs(a - b) < f))
+    return std::min(a, b) + f;
+  double d = double(a) - double(b);
+  return float((double(a) + double(b) + std::sqrt(2.0*double(f)*f - d*d))/2);
+}
+
+// Fast marching: accepts cells in increasing time order from the goal.
+// Exact ordering, O(n log n), single threaded.
+inline time_field fast_marching(const maze& m, vertex_descriptor goal) {
+  const std::size_t w = m.length(0), h = m.length(1);
+  std::vector<float> f = slownessField(m);
+  time_field T(m.num_cells(), kInfiniteTime);
+  std::vector<uint8_t> known(m.num_cells(), 0);
+  const std::size_t g = m.index(goal);
+  if (!m.passable(g))
+    return T;
+
+  open_list open;
+  T[g] = 0;
+  open.push(open_entry(0, uint32_t(g)));
+  while (!open.empty()) {
+    open_entry top = open.top();
+    open.pop();
+    std::size_t u = top.second;
+    if (known[u] || float(top.first) != T[u])
+      continue;
+    known[u] = 1;
+    m.for_each_neighbour(u, [&](std::size_t v) {
+      if (known[v])
+        return;
+      std::size_t x = v % w, y = v / w;
+      float a = std::min(x > 0 && known[v - 1] ? T[v - 1] : kInfiniteTime,
+                         x + 1 < w && known[v + 1] ? T[v + 1] : kInfiniteTime);
+      float b = std::min(y > 0 && known[v - w] ? T[v - w] : kInfiniteTime,
+                         y + 1 < h && known[v + w] ? T[v + w] : kInfiniteTime);
+      float t = eikonalUpdate(a, b, f[v]);
+      if (t < T[v]) {
+        T[v] = t;
+        open.push(open_entry(t, uint32_t(v)));
+      }
+    });
+  }
+  return T;
+}
+
+namespace detail {
+
+// One-dimensional vertical update of a whole row: b = min(up, down) and
+// row = min(row, b + f).  Contiguous in x, so it runs four cells per step.
+// Returns whether anything changed.
+inline bool sweepRowVertical(float* row, float* b, const float* up, const float* down,
+                             const float* f, std::size_t n) {
+  std::size_t x = 0;
+  bool changed = false;
+#ifdef __SSE2__
+  __m128 anyLower = _mm_setzero_ps();
+  for (; x + 4 <= n; x += 4) {
+    __m128 vb = _mm_min_ps(_mm_loadu_ps(up + x), _mm_loadu_ps(down + x));
+    _mm_storeu_ps(b + x, vb);
+    __m128 old = _mm_loadu_ps(row + x);
+    __m128 candidate = _mm_add_ps(vb, _mm_loadu_ps(f + x));
+    anyLower = _mm_or_ps(anyLower, _mm_cmplt_ps(candidate, old));
+    _mm_storeu_ps(row + x, _mm_min_ps(old, candidate));
+  }
+  changed = _mm_movemask_ps(anyLower) != 0;
+#endif
+  for (; x < n; ++x) {
+    b[x] = std::min(up[x], down[x]);
+    if (b[x] + f[x] < row[x]) {row[x] = b[x] + f[x]; changed = true;}
+  }
+  return changed;
+}
+
+// Full Godunov update of a row given its vertical minima, sweeping left to
+// right and back so that information crosses the row in one pass.  Returns
+// whether anything changed.
+inline bool sweepRowHorizontal(float* row, const float* b, const float* f, std::size_t n) {
+  bool changed = false;
+  for (std::size_t x = 1; x < n; ++x) {
+    float t = eikonalUpdate(row[x - 1], b[x], f[x]);
+    if (t < row[x]) {row[x] = t; changed = true;}
+  }
+  for (std::size_t x = n - 1; x-- > 0;) {
+    float t = eikonalUpdate(row[x + 1], b[x], f[x]);
+    if (t < row[x]) {row[x] = t; changed = true;}
+  }
+  return changed;
+}
+
+} // namespace detail
+
+// Fast sweeping: Gauss-Seidel sweeps down and up the grid until the field
+// stops changing.  Rows are split into one band per thread; each band sweeps
+// against a snapshot of its neighbours' edge rows, which are exchanged between
+// iterations.  The vertical half of each row update is vectorised.
+//
+// Only the spans of the goal's region are swept.  Barriers and other
+// islands keep an infinite time whatever the sweep does, so the field is the
+// same as sweeping whole rows.
+inline time_field fast_sweeping(const maze& m, const free_spans& spans, vertex_descriptor goal,
+                                unsigned threads = default_threads(),
+                                std::size_t maxIterations = 1000) {
+  const std::size_t w = m.length(0), h = m.length(1);
+  std::vector<float> f = slownessField(m);
+  time_field T(m.num_cells(), kInfiniteTime);
+  const std::size_t g = m.index(goal);
+  if (!m.passable(g))
+    return T;
+  T[g] = 0;
+  f[g] = kInfiniteTime;   // keeps the source fixed at 0
+  const free_spans region = span_region(spans, g);
+
+  threads = std::max(1u, std::min<unsigned>(threads, unsigned(h)));
+  std::vector<std::size_t> bands(threads + 1);
+  for (unsigned t = 0; t <= threads; ++t)
+    bands[t] = h*t/threads;
+  // Halo rows above and below every band, plus an all-infinite row for the
+  // map edges.
+  std::vector<float> halo(2*threads*w), border(w, kInfiniteTime);
+  std::vector<uint8_t> changed(threads);
+
+  for (std::size_t iteration = 0; iteration < maxIterations; ++iteration) {
+    for (unsigned t = 0; t < threads; ++t) {
+      if (bands[t] > 0)
+        std::copy_n(&T[(bands[t] - 1)*w], w, &halo[(2*t)*w]);
+      if (bands[t + 1] < h)
+        std::copy_n(&T[bands[t + 1]*w], w, &halo[(2*t + 1)*w]);
+    }
+
+    auto sweepBand = [&](unsigned t) {
+      const std::size_t y0 = bands[t], y1 = bands[t + 1];
+      const float* above = y0 > 0 ? &halo[(2*t)*w] : &border[0];
+      const float* below = y1 < h ? &halo[(2*t + 1)*w] : &border[0];
+      std::vector<float> b(w);
+      bool any = false;
+      auto rowAt = [&](long y) {
+        return y < long(y0) ? above : (y >= long(y1) ? below : &T[y*w]);
+      };
+      for (int pass = 0; pass < 2; ++pass)
+        for (std::size_t k = 0; k < y1 - y0; ++k) {
+          std::size_t y = pass == 0 ? y0 + k : y1 - 1 - k;
+          float* row = &T[y*w];
+          const float* up = rowAt(long(y) - 1);
+          const float* down = rowAt(long(y) + 1);
+          for (std::size_t s = region.row_begin(y); s < region.row_begin(y + 1); ++s) {
+            const std::size_t x = region[s].begin, n = region[s].end - x;
+            bool vertical = detail::sweepRowVertical(row + x, &b[x], up + x, down + x, &f[y*w + x], n);
+            bool horizontal = detail::sweepRowHorizontal(row + x, &b[x], &f[y*w + x], n);
+            any = any || vertical || horizontal;
+          }
+        }
+      changed[t] = any;
+    };
+
+    parallel_invoke(threads, sweepBand);
+
+    if (std::find(changed.begin(), changed.end(), 1) == changed.end())
+      break;
+  }
+  return T;
+}
+
+inline time_field fast_sweeping(const maze& m, vertex_descriptor goal,
+                                unsigned threads = default_threads(),
+                                std::size_t maxIterations = 1000) {
+  return fast_sweeping(m, free_spans(m, threads), goal, threads, maxIterations);
+}
+
+// Follow the field downhill from start to the cell where it is zero.  Each
+// step moves to the lowest 8-neighbour that does not cut a barrier corner, so
+// extraction costs O(path length).  Returns an empty path if start cannot
+// reach the goal.
+inline std::vector<vertex_descriptor> descend(const maze& m, const time_field& T, vertex_descriptor start) {
+  const long w = long(m.length(0)), h = long(m.length(1));
+  std::vector<vertex_descriptor> path;
+  std::size_t u = m.index(start);
+  if (!(T[u] < kInfiniteTime))
+    return path;
+  path.push_back(start);
+  while (T[u] > 0) {
+    const long x = long(u) % w, y = long(u) / w;
+    std::size_t next = u;
+    for (long ny = std::max(0L, y - 1); ny <= std::min(h - 1, y + 1); ++ny)
+      for (long nx = std::max(0L, x - 1); nx <= std::min(w - 1, x + 1); ++nx) {
+        std::size_t n = std::size_t(nx + ny*w);
+        if (nx != x && ny != y && !m.passable(std::size_t(nx + y*w)) &&
+            !m.passable(std::size_t(x + ny*w)))
+          continue;
+        if (T[n] < T[next])
+          next = n;
+      }
+    if (next == u)
+      return std::vector<vertex_descriptor>();
+    u = next;
+    path.push_back(m.cell(u));
+  }
+  return path;
+}
+
+#endif
@@ -0,0 +1,335 @@
+#ifndef EXTERNAL_SEARCH_HPP
+#define EXTERNAL_SEARCH_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "tiled_map.hpp"
+#include "utility.hpp"
+
+// External-memory shortest paths over a tiled map.
+//
+// For maps whose per-cell search state does not fit in RAM, the state is cut
+// into the same tiles as the map and spilled to a scratch file, with only a
+// bounded number of blocks resident.  The open list is a bucket queue whose
+// buckets are append-only files: pushes are buffered and written
+// sequentially, and each bucket is read back in one pass and sorted by tile
+// before it is processed, so state blocks are visited in order.
+//
+// Buckets are one island second wide.  No move takes less than a second, so a
+// cell can never improve another cell of its own bucket; every bucket can be
+// settled in any order and the distances are exactly Dijkstra's.
+
+struct external_options {
+  // Directory for the state and bucket scratch files
+  std::string scratch_dir = ".";
+  // State blocks kept in memory
+  std::size_t resident_blocks = 64;
+  // Bucket entries buffered in memory before being appended to disk
+  std::size_t bucket_buffer = 1 << 16;
+};
+
+struct external_stats {
+  std::size_t bytes_read;
+  std::size_t bytes_written;
+  std::size_t block_loads;
+  std::size_t block_stores;
+  std::size_t settled;
+};
+
+namespace detail {
+
+// Prefix for the scratch files of one search, unique to the process and the
+// call, so that searches sharing a scratch directory never share files.
+inline std::string scratchPrefix(const std::string& dir) {
+  static std::atomic<unsigned long> calls(0);
+#ifdef TILED_MAP_HAS_MMAP
+  const unsigned long process = (unsigned long)getpid();
+#else
+  const unsigned long process = 0;
+#endif
+  return dir + "/search_" + std::to_string(process) + "_" + std::to_string(calls.fetch_add(1));
+}
+
+// Per-cell search state cut into tile-sized blocks backed by a scratch file.
+class state_store {
+public:
+  enum {SETTLED = 0x80, DIRECTION = 0x07};
+
+  state_store(const tiled_map& map, const external_options& options, const std::string& prefix,
+              external_stats& stats):
+    m_tile(map.tile_size()), m_tilesX((map.width() + m_tile - 1)/m_tile),
+    m_capacity(std::max<std::size_t>(1, options.resident_blocks)), m_stats(stats) {
+    std::size_t tilesY = (map.height() + m_tile - 1)/m_tile;
+    m_onDisk.assign(m_tilesX*tilesY, false);
+    m_path = prefix + "_state.bin";
+    m_file = std::fopen(m_path.c_str(), "w+b");
+    if (!m_file)
+      throw std::exception();
+  }
+  ~state_store() {
+    std::fclose(m_file);
+    std::remove(m_path.c_str());
+  }
+  state_store(const state_store&) = delete;
+  state_store& operator=(const state_store&) = delete;
+
+  // Distance and flags of a cell.  Reading leaves the block clean, so a
+  // block that was only read is dropped on eviction instead of written back.
+  distance dist(uint64_t x, uint64_t y) {return fetch(x, y).dist[offset(x, y)];}
+  uint8_t flags(uint64_t x, uint64_t y) {return fetch(x, y).flags[offset(x, y)];}
+
+  void set_dist(uint64_t x, uint64_t y, distance d) {
+    block& b = fetch(x, y);
+    b.dirty = true;
+    b.dist[offset(x, y)] = d;
+  }
+  void set_flags(uint64_t x, uint64_t y, uint8_t f) {
+    block& b = fetch(x, y);
+    b.dirty = true;
+    b.flags[offset(x, y)] = f;
+  }
+
+private:
+  struct block {
+    std::vector<distance> dist;
+    std::vector<uint8_t> flags;
+    bool dirty;
+    std::list<std::size_t>::iterator lru;
+  };
+
+  std::size_t offset(uint64_t x, uint64_t y) const {return std::size_t((y % m_tile)*m_tile + x % m_tile);}
+  std::size_t blockBytes() const {return m_tile*m_tile*(sizeof(distance) + 1);}
+
+  block& fetch(uint64_t x, uint64_t y) {
+    std::size_t key = std::size_t((y/m_tile)*m_tilesX + x/m_tile);
+    auto found = m_blocks.find(key);
+    if (found != m_blocks.end()) {
+      m_lru.splice(m_lru.begin(), m_lru, found->second.lru);
+      return found->second;
+    }
+    if (m_blocks.size() >= m_capacity) {
+      std::size_t victim = m_lru.back();
+      m_lru.pop_back();
+      store(victim, m_blocks[victim]);
+      m_blocks.erase(victim);
+    }
+    block& b = m_blocks[key];
+    b.dist.assign(m_tile*m_tile, std::numeric_limits<distance>::infinity());
+    b.flags.assign(m_tile*m_tile, 0);
+    b.dirty = false;
+    if (m_onDisk[key]) {
+      std::fseek(m_file, long(key*blockBytes()), SEEK_SET);
+      std::size_t n = std::fread(&b.dist[0], sizeof(distance), b.dist.size(), m_file);
+      n += std::fread(&b.flags[0], 1, b.flags.size(), m_file);
+      if (n != 2*b.dist.size())
+        throw std::exception();
+      m_stats.bytes_read += blockBytes();
+      ++m_stats.block_loads;
+    }
+    m_lru.push_front(key);
+    b.lru = m_lru.begin();
+    return b;
+  }
+
+  void store(std::size_t key, const block& b) {
+    if (!b.dirty)
+      return;
+    std::fseek(m_file, long(key*blockBytes()), SEEK_SET);
+    std::fwrite(&b.dist[0], sizeof(distance), b.dist.size(), m_file);
+    std::fwrite(&b.flags[0], 1, b.flags.size(), m_file);
+    m_onDisk[key] = true;
+    m_stats.bytes_written += blockBytes();
+    ++m_stats.block_stores;
+  }
+
+  std::size_t m_tile;
+  std::size_t m_tilesX;
+  std::size_t m_capacity;
+  external_stats& m_stats;
+  std::string m_path;
+  std::FILE* m_file;
+  std::vector<bool> m_onDisk;
+  std::unordered_map<std::size_t, block> m_blocks;
+  std::list<std::size_t> m_lru;
+};
+
+// Ring of one-second buckets, each an append-only scratch file.
+class bucket_queue {
+public:
+  struct entry {
+    distance dist;
+    uint64_t cell;
+  };
+
+  bucket_queue(std::size_t ring, const external_options& options, const std::string& prefix,
+               external_stats& stats):
+    m_buffers(ring), m_files(ring), m_sizes(ring, 0), m_current(0),
+    m_limit(std::max<std::size_t>(1, options.bucket_buffer)), m_stats(stats) {
+    for (std::size_t k = 0; k < ring; ++k) {
+      m_paths.push_back(prefix + "_bucket_" + std::to_string(k) + ".bin");
+      m_files[k] = std::fopen(m_paths[k].c_str(), "w+b");
+      if (!m_files[k])
+        throw std::exception();
+    }
+  }
+  ~bucket_queue() {
+    for (std::size_t k = 0; k < m_files.size(); ++k) {
+      if (m_files[k])
+        std::fclose(m_files[k]);
+      std::remove(m_paths[k].c_str());
+    }
+  }
+  bucket_queue(const bucket_queue&) = delete;
+  bucket_queue& operator=(const bucket_queue&) = delete;
+
+  void push(distance d, uint64_t cell) {
+    std::size_t k = std::size_t(d) % m_buffers.size();
+    entry e = {d, cell};
+    m_buffers[k].push_back(e);
+    if (m_buffers[k].size() >= m_limit) {
+      std::fwrite(&m_buffers[k][0], sizeof(entry), m_buffers[k].size(), m_files[k]);
+      m_sizes[k] += m_buffers[k].size();
+      m_stats.bytes_written += m_buffers[k].size()*sizeof(entry);
+      m_buffers[k].clear();
+    }
+  }
+
+  // Take every entry of the lowest non-empty bucket.  Returns false when the
+  // queue is empty.
+  bool pop_bucket(std::vector<entry>& entries) {
+    const std::size_t ring = m_buffers.size();
+    for (std::size_t step = 0; step < ring; ++step, ++m_current) {
+      std::size_t k = m_current % ring;
+      if (m_buffers[k].empty() && m_sizes[k] == 0)
+        continue;
+      entries.resize(m_sizes[k]);
+      if (m_sizes[k]) {
+        std::rewind(m_files[k]);
+        if (std::fread(&entries[0], sizeof(entry), m_sizes[k], m_files[k]) != m_sizes[k])
+          throw std::exception();
+        m_stats.bytes_read += m_sizes[k]*sizeof(entry);
+        std::fclose(m_files[k]);
+        m_files[k] = std::fopen(m_paths[k].c_str(), "w+b");
+        if (!m_files[k])
+          throw std::exception();
+        m_sizes[k] = 0;
+      }
+      entries.insert(entries.end(), m_buffers[k].begin(), m_buffers[k].end());
+      m_buffers[k].clear();
+      ++m_current;
+      return true;
+    }
+    return false;
+  }
+
+private:
+  std::vector<std::vector<entry> > m_buffers;
+  std::vector<std::FILE*> m_files;
+  std::vector<std::string> m_paths;
+  std::vector<std::size_t> m_sizes;
+  std::size_t m_current;
+  std::size_t m_limit;
+  external_stats& m_stats;
+};
+
+} // namespace detail
+
+// Shortest path from source to goal with all search state on disk.
+// Returns true and fills path and length if the goal is reachable.
+inline bool external_solve(tiled_map& map, vertex_descriptor source, vertex_descriptor goal,
+                           std::vector<vertex_descriptor>& path, distance& length,
+                           const external_options& options = external_options(),
+                           external_stats* stats = nullptr) {
+  external_stats local = external_stats();
+  external_stats& st = stats ? *stats : local;
+  st = external_stats();
+  if (!map.passable(source[0], source[1]) || !map.passable(goal[0], goal[1]))
+    return false;
+
+  const uint64_t w = map.width(), h = map.height(), T = map.tile_size();
+  const std::string prefix = detail::scratchPrefix(options.scratch_dir);
+  detail::state_store state(map, options, prefix, st);
+  // No move costs more than the steepest climb, so pushes land at most this
+  // many buckets ahead.
+  detail::bucket_queue queue(std::size_t(std::ceil(slopeTime(1, 255))) + 2, options, prefix, st);
+
+  // Neighbour offsets and the direction code stored as predecessor: the
+  // predecessor of a cell reached through move k lies at -offset[k].
+  const int64_t dx[4] = {-1, 1, 0, 0};
+  const int64_t dy[4] = {0, 0, -1, 1};
+
+  state.set_dist(source[0], source[1], 0);
+  queue.push(0, source[1]*w + source[0]);
+  std::vector<detail::bucket_queue::entry> entries;
+  bool found = false;
+  while (!found && queue.pop_bucket(entries)) {
+    // Tile-major order keeps consecutive accesses in the same state block.
+    auto tileOrder = [&](const detail::bucket_queue::entry& e) {
+      uint64_t x = e.cell % w, y = e.cell / w;
+      return std::make_pair(((y/T)*w + x/T), e.cell);
+    };
+    std::sort(entries.begin(), entries.end(),
+              [&](const detail::bucket_queue::entry& a, const detail::bucket_queue::entry& b) {
+                return tileOrder(a) < tileOrder(b);
+              });
+    for (const detail::bucket_queue::entry& e : entries) {
+      const uint64_t ux = e.cell % w, uy = e.cell / w;
+      if (state.dist(ux, uy) != e.dist)
+        continue;
+      const uint8_t flags = state.flags(ux, uy);
+      if (flags & detail::state_store::SETTLED)
+        continue;
+      state.set_flags(ux, uy, uint8_t(flags | detail::state_store::SETTLED));
+      ++st.settled;
+      if (ux == goal[0] && uy == goal[1]) {
+        found = true;
+        break;
+      }
+      const int eu = map.at(ux, uy);
+      for (int k = 0; k < 4; ++k) {
+        const uint64_t vx = ux + dx[k], vy = uy + dy[k];
+        if (vx >= w || vy >= h)
+          continue;
+        const int ev = map.at(vx, vy);
+        if (ev == 0 || (state.flags(vx, vy) & detail::state_store::SETTLED))
+          continue;
+        const distance d = e.dist + stepTime(ev - eu);
+        if (d < state.dist(vx, vy)) {
+          state.set_dist(vx, vy, d);
+          const uint8_t fv = state.flags(vx, vy);
+          state.set_flags(vx, vy, uint8_t((fv & ~detail::state_store::DIRECTION) | (k + 1)));
+          queue.push(d, vy*w + vx);
+        }
+      }
+    }
+  }
+  if (!found)
+    return false;
+
+  length = state.dist(goal[0], goal[1]);
+  path.clear();
+  uint64_t x = goal[0], y = goal[1];
+  while (true) {
+    vertex_descriptor cell = {{std::size_t(x), std::size_t(y)}};
+    path.push_back(cell);
+    int k = (state.flags(x, y) & detail::state_store::DIRECTION) - 1;
+    if (k < 0)
+      break;
+    x -= dx[k];
+    y -= dy[k];
+  }
+  std::reverse(path.begin(), path.end());
+  return true;
+}
+
+#endif
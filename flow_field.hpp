@@ -0,0 +1,243 @@
+#ifndef FLOW_FIELD_HPP
+#define FLOW_FIELD_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "cell_memory.hpp"
+#include "parallel.hpp"
+#include "search_scratch.hpp"
+#include "utility.hpp"
+
+// Flow fields: one search serving every agent headed for the same goal.
+//
+// A flow field is the distance of every cell to a goal, from one Dijkstra
+// rooted at the goal (costs are symmetric), plus the step each cell takes
+// towards it.  Steps are packed two bits per cell, 32 cells per word, so an
+// agent anywhere follows the field with one load and a shift per step.
+//
+// The step of a cell goes to the first neighbour, in for_each_edge order,
+// that realises its distance.  Being a pure function of the distances it
+// comes out the same however they were computed, so a repaired field is
+// identical to a rebuilt one.
+
+// Steps
+enum {FLOW_WEST = 0, FLOW_EAST = 1, FLOW_NORTH = 2, FLOW_SOUTH = 3};
+
+class flow_field {
+public:
+  flow_field():m_width(0),m_goal(0) {};
+
+  // Field towards goal over maze m.
+  void build(const maze& m, vertex_descriptor goal, unsigned threads = default_threads()) {
+    const std::size_t cells = m.num_cells();
+    m_width = m.length(0);
+    m_goal = m.index(goal);
+    m_dist.assign(cells, std::numeric_limits<distance>::infinity());
+    m_steps.assign((cells + 31)/32, 0);
+    if (!m.passable(m_goal))
+      return;
+    open_list open;
+    m_dist[m_goal] = 0;
+    open.push(open_entry(0, uint32_t(m_goal)));
+    propagate(m, open, nullptr);
+    parallel_for(0, m_steps.size(), threads, [&](std::size_t first, std::size_t last, unsigned) {
+      for (std::size_t k = first; k < last; ++k)
+        for (std::size_t i = k*32; i < k*32 + 32 && i < cells; ++i)
+          assignStep(m, i);
+    });
+  }
+
+  // Repair the field after the cells in changed were given new overrides
+  // and m was rebuilt from them.  Every cell whose steps led through a
+  // changed cell is reset and searched again from the cells around it,
+  // and any improvement spreads from there, so the work follows the part of
+  // the field that changed.  scratch marks the reset cells.
+  void update(const maze& m, const std::vector<uint32_t>& changed, search_scratch& scratch) {
+    const std::size_t cells = m.num_cells();
+    scratch.reset(cells);
+    // Changed cells and everything upstream of them, by the old steps
+    std::vector<uint32_t> reset;
+    for (uint32_t c : changed)
+      if (!scratch.closed(c)) {
+        scratch.close(c);
+        reset.push_back(c);
+      }
+    for (std::size_t k = 0; k < reset.size(); ++k) {
+      const std::size_t u = reset[k];
+      const std::size_t x = u % m_width;
+      auto upstream = [&](std::size_t n, uint32_t stepToU) {
+        if (!scratch.closed(n) && reaches(n) && step(n) == stepToU) {
+          scratch.close(n);
+          reset.push_back(uint32_t(n));
+        }
+      };
+      if (x > 0) upstream(u - 1, FLOW_EAST);
+      if (x + 1 < m_width) upstream(u + 1, FLOW_WEST);
+      if (u >= m_width) upstream(u - m_width, FLOW_SOUTH);
+      if (u + m_width < cells) upstream(u + m_width, FLOW_NORTH);
+    }
+    for (uint32_t u : reset)
+      m_dist[u] = std::numeric_limits<distance>::infinity();
+
+    // Search again from the edge of the reset cells
+    open_list open;
+    for (uint32_t u : reset) {
+      if (u == m_goal && m.passable(u))
+        m_dist[u] = 0;
+      m.for_each_edge(u, [&](std::size_t n, double w) {
+        if (m_dist[n] + w < m_dist[u])
+          m_dist[u] = m_dist[n] + w;
+      });
+      if (m_dist[u] < std::numeric_limits<distance>::infinity())
+        open.push(open_entry(m_dist[u], u));
+    }
+    std::vector<uint32_t> touched(reset);
+    propagate(m, open, &touched);
+
+    // Steps of every cell whose distance or neighbourhood changed
+    for (uint32_t u : touched) {
+      assignStep(m, u);
+      const std::size_t x = u % m_width;
+      if (x > 0) assignStep(m, u - 1);
+      if (x + 1 < m_width) assignStep(m, u + 1);
+      if (u >= m_width) assignStep(m, u - m_width);
+      if (u + m_width < cells) assignStep(m, u + m_width);
+    }
+  }
+
+  std::size_t goal() const {return m_goal;}
+  // Whether an agent at cell i can reach the goal
+  bool reaches(std::size_t i) const {return m_dist[i] < std::numeric_limits<distance>::infinity();}
+  // Travel time from cell i to the goal, infinite if it cannot get there
+  distance time(std::size_t i) const {return m_dist[i];}
+  // Step from cell i, one of the FLOW_ steps.  Meaningless at the goal and
+  // where the goal cannot be reached.
+  uint32_t step(std::size_t i) const {return uint32_t(m_steps[i >> 5] >> ((i & 31)*2)) & 3;}
+  // The cell after i on the way to the goal
+  std::size_t next(std::size_t i) const {
+    switch (step(i)) {
+    case FLOW_WEST: return i - 1;
+    case FLOW_EAST: return i + 1;
+    case FLOW_NORTH: return i - m_width;
+    default: return i + m_width;
+    }
+  }
+
+  // Path from start to the goal.  Empty if start cannot reach it.
+  std::vector<vertex_descriptor> path(const maze& m, vertex_descriptor start) const {
+    std::vector<vertex_descriptor> result;
+    std::size_t i = m.index(start);
+    if (!reaches(i))
+      return result;
+    result.push_back(start);
+    for (; i != m_goal; i = next(i))
+      result.push_back(m.cell(next(i)));
+    return result;
+  }
+
+  std::size_t memory_bytes() const {
+    return m_dist.size()*sizeof(distance) + m_steps.size()*sizeof(uint64_t);
+  }
+
+private:
+  // Dijkstra from the queued cells, lowering distances only.  Stale entries
+  // are those whose key no longer matches the cell's distance.  Cells whose
+  // distance was lowered are added to touched.
+  void propagate(const maze& m, open_list& open, std::vector<uint32_t>* touched) {
+    while (!open.empty()) {
+      open_entry top = open.top();
+      open.pop();
+      const std::size_t u = top.second;
+      if (top.first != m_dist[u])
+        continue;
+      m.for_each_edge(u, [&](std::size_t v, double w) {
+        distance d = top.first + w;
+        if (d < m_dist[v]) {
+          m_dist[v] = d;
+          open.push(open_entry(d, uint32_t(v)));
+          if (touched)
+            touched->push_back(uint32_t(v));
+        }
+      });
+    }
+  }
+
+  void assignStep(const maze& m, std::size_t i) {
+    uint32_t s = 0;
+    if (i != m_goal && reaches(i)) {
+      bool found = false;
+      m.for_each_edge(i, [&](std::size_t n, double w) {
+        if (!found && m_dist[n] + w == m_dist[i]) {
+          s = n + 1 == i ? FLOW_WEST : n == i + 1 ? FLOW_EAST : n < i ? FLOW_NORTH : FLOW_SOUTH;
+          found = true;
+        }
+      });
+    }
+    uint64_t& word = m_steps[i >> 5];
+    const unsigned shift = unsigned(i & 31)*2;
+    word = (word & ~(uint64_t(3) << shift)) | (uint64_t(s) << shift);
+  }
+
+  std::size_t m_width;
+  std::size_t m_goal;
+  // Travel time of every cell to the goal
+  cell_vector<distance> m_dist;
+  // Two bits per cell, see step()
+  cell_vector<uint64_t> m_steps;
+};
+
+// Flow fields for the most recently used goals.
+//
+// get() builds the field of a goal the first time it is asked for and
+// evicts the least recently used one when the cache is full.  update()
+// repairs every cached field after an override change.
+class flow_field_cache {
+public:
+  explicit flow_field_cache(std::size_t capacity = 8):m_capacity(capacity ? capacity : 1),m_clock(0) {};
+
+  const flow_field& get(const maze& m, vertex_descriptor goal) {
+    const std::size_t g = m.index(goal);
+    std::size_t slot = m_fields.size();
+    for (std::size_t k = 0; k < m_fields.size(); ++k)
+      if (m_fields[k].field->goal() == g)
+        slot = k;
+    if (slot == m_fields.size()) {
+      if (m_fields.size() < m_capacity) {
+        m_fields.push_back(entry());
+        m_fields.back().field.reset(new flow_field);
+      } else {
+        slot = 0;
+        for (std::size_t k = 1; k < m_fields.size(); ++k)
+          if (m_fields[k].used < m_fields[slot].used)
+            slot = k;
+      }
+      m_fields[slot].field->build(m, goal);
+    }
+    m_fields[slot].used = ++m_clock;
+    return *m_fields[slot].field;
+  }
+
+  void update(const maze& m, const std::vector<uint32_t>& changed) {
+    for (entry& e : m_fields)
+      e.field->update(m, changed, m_scratch);
+  }
+
+  std::size_t size() const {return m_fields.size();}
+
+private:
+  struct entry {
+    std::unique_ptr<flow_field> field;
+    uint64_t used;
+  };
+
+  std::size_t m_capacity;
+  uint64_t m_clock;
+  std::vector<entry> m_fields;
+  search_scratch m_scratch;
+};
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef FREE_SPANS_HPP
+#define FREE_SPANS_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "map_build.hpp"
+#include "parallel.hpp"
+#include "utility.hpp"
+
+// Run-length representation of the traversable cells.
+//
+// Each row is a sorted list of spans.  A span is a maximal run [begin, end)
+// of passable cells, stored as a detail::cell_run.  Spans are numbered row by
+// row, left to right.  Whole-map passes walk spans rather than cells, so a
+// river or lake is skipped in one step.  Region queries flood from span to
+// span: two spans in adjacent rows touch when their columns overlap, which
+// is 4-connectivity.
+class free_spans {
+public:
+  typedef detail::cell_run span;
+
+  free_spans():m_width(0),m_cells(0) {m_rowStart.push_back(0);}
+
+  // Spans of the passable cells of a maze, rows split across threads.
+  explicit free_spans(const maze& m, unsigned threads = default_threads()):m_width(m.length(0)) {
+    const std::size_t w = m.length(0), h = m.length(1);
+    const uint64_t* bits = &m.m_passable[0];
+    std::vector<std::vector<span> > bands(std::max(1u, threads));
+    parallel_for(0, h, threads, [&](std::size_t first, std::size_t last, unsigned t) {
+      for (std::size_t y = first; y < last; ++y)
+        detail::appendBitRuns(bits, y*w, w, uint32_t(y), bands[t]);
+    });
+    std::size_t total = 0;
+    for (const std::vector<span>& band : bands)
+      total += band.size();
+    m_spans.reserve(total);
+    for (const std::vector<span>& band : bands)
+      m_spans.insert(m_spans.end(), band.begin(), band.end());
+    index(h);
+  }
+
+  // Spans given explicitly, sorted by row and then column, for a width x
+  // height map.
+  free_spans(std::size_t width, std::size_t height, std::vector<span> spans):
+    m_width(width), m_spans(std::move(spans)) {
+    index(height);
+  }
+
+  std::size_t width() const {return m_width;}
+  std::size_t height() const {return m_rowStart.size() - 1;}
+  // Number of spans
+  std::size_t size() const {return m_spans.size();}
+  // Number of cells covered by the spans
+  std::size_t cells() const {return m_cells;}
+  const span& operator[](std::size_t k) const {return m_spans[k];}
+  // The spans of row y are [row_begin(y), row_begin(y + 1)).
+  std::size_t row_begin(std::size_t y) const {return m_rowStart[y];}
+
+  // Span holding a flat cell index, or size() if the cell is in none.
+  std::size_t find(std::size_t cell) const {
+    const std::size_t y = cell / m_width;
+    const uint32_t x = uint32_t(cell % m_width);
+    std::size_t k = firstEndingAfter(m_rowStart[y], m_rowStart[y + 1], x);
+    return k < m_rowStart[y + 1] && m_spans[k].begin <= x ? k : size();
+  }
+
+  // Call f(j) for every span j in the rows above and below span k that
+  // touches it.
+  template <typename F>
+  void for_each_touching(std::size_t k, F f) const {
+    const span& s = m_spans[k];
+    auto row = [&](std::size_t y) {
+      const std::size_t last = m_rowStart[y + 1];
+      std::size_t j = firstEndingAfter(m_rowStart[y], last, s.begin);
+      for (; j < last && m_spans[j].begin < s.end; ++j)
+        f(j);
+    };
+    if (s.row > 0)
+      row(s.row - 1);
+    if (s.row + 1 < height())
+      row(s.row + 1);
+  }
+
+  std::size_t memory_bytes() const {
+    return m_spans.size()*sizeof(span) + m_rowStart.size()*sizeof(std::size_t);
+  }
+
+private:
+  // First span in [first, last) of one row whose end lies past column x
+  std::size_t firstEndingAfter(std::size_t first, std::size_t last, uint32_t x) const {
+    return std::size_t(std::upper_bound(m_spans.begin() + first, m_spans.begin() + last, x,
+                                        [](uint32_t v, const span& s) {return v < s.end;}) -
+                       m_spans.begin());
+  }
+
+  void index(std::size_t height) {
+    m_rowStart.assign(height + 1, 0);
+    m_cells = 0;
+    for (const span& s : m_spans) {
+      ++m_rowStart[s.row + 1];
+      m_cells += s.end - s.begin;
+    }
+    for (std::size_t y = 0; y < height; ++y)
+      m_rowStart[y + 1] += m_rowStart[y];
+  }
+
+  std::size_t m_width;
+  std::vector<span> m_spans;
+  std::vector<std::size_t> m_rowStart;
+  std::size_t m_cells;
+};
+
+// Flood from span seed through touching spans that are still unlabelled (0),
+// giving each the label value.  Calls visit(k) once for every span labelled.
+template <typename F>
+void flood_spans(const free_spans& spans, std::size_t seed, std::vector<uint32_t>& label, uint32_t value,
+                 F visit) {
+  if (label[seed] != 0)
+    return;
+  std::vector<std::size_t> stack(1, seed);
+  label[seed] = value;
+  while (!stack.empty()) {
+    std::size_t k = stack.back();
+    stack.pop_back();
+    visit(k);
+    spans.for_each_touching(k, [&](std::size_t j) {
+      if (label[j] == 0) {
+        label[j] = value;
+        stack.push_back(j);
+      }
+    });
+  }
+}
+
+// Label every span with its connected region, numbered from 1 in the order
+// of the region's first span.  That is the numbering of maze::component.
+// Returns the number of regions.
+inline uint32_t label_span_components(const free_spans& spans, std::vector<uint32_t>& label) {
+  label.assign(spans.size(), 0);
+  uint32_t components = 0;
+  for (std::size_t k = 0; k < spans.size(); ++k)
+    if (label[k] == 0)
+      flood_spans(spans, k, label, ++components, [](std::size_t) {});
+  return components;
+}
+
+// Spans of the region holding a flat cell index, in span order.  Empty if
+// the cell is a barrier.
+inline free_spans span_region(const free_spans& spans, std::size_t cell) {
+  std::vector<free_spans::span> region;
+  const std::size_t seed = spans.find(cell);
+  if (seed < spans.size()) {
+    std::vector<uint32_t> label(spans.size(), 0);
+    std::vector<std::size_t> members;
+    flood_spans(spans, seed, label, 1, [&](std::size_t k) {members.push_back(k);});
+    std::sort(members.begin(), members.end());
+    region.reserve(members.size());
+    for (std::size_t k : members)
+      region.push_back(spans[k]);
+  }
+  return free_spans(spans.width(), spans.height(), std::move(region));
+}
+
+// The cells of spans whose value in a per-cell field (a time_field, a
+// shortest_path_tree distance, ...) is at most limit, as spans.  On a field
+// of times from a source this is the isochrone of the limit.
+template <typename Field>
+free_spans level_set(const free_spans& spans, const Field& field, double limit) {
+  std::vector<free_spans::span> inside;
+  const std::size_t w = spans.width();
+  for (std::size_t k = 0; k < spans.size(); ++k) {
+    const free_spans::span& s = spans[k];
+    const std::size_t row = std::size_t(s.row)*w;
+    for (uint32_t x = s.begin; x < s.end;) {
+      while (x < s.end && !(field[row + x] <= limit))
+        ++x;
+      uint32_t begin = x;
+      while (x < s.end && field[row + x] <= limit)
+        ++x;
+      if (x > begin) {
+        free_spans::span r = {s.row, begin, x};
+        inside.push_back(r);
+      }
+    }
+  }
+  return free_spans(w, spans.height(), std::move(inside));
+}
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef ISOCHRONE_HPP
+#define ISOCHRONE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "search_scratch.hpp"
+#include "utility.hpp"
+
+// Everything a rover can reach within a time budget.
+//
+// One Dijkstra from the source that never queues a cell arriving after the
+// budget, so the work is proportional to the area reached rather than the
+// map.  It runs on the same search_scratch as the point-to-point
+// searches.
+
+struct isochrone {
+  // Cells of the whole map
+  std::size_t map_cells;
+  // One bit per map cell, laid out like maze::m_passable, set where reached
+  cell_vector<uint64_t> reached;
+  // Reached cells in order of arrival, and their arrival times
+  std::vector<uint32_t> cells;
+  std::vector<float> times;
+
+  bool contains(std::size_t i) const {return ((reached[i >> 6] >> (i & 63)) & 1) != 0;}
+
+  // Arrival times as a plane over the whole map, infinite outside, for
+  // visualizer::Overlay::drawContours.
+  std::vector<float> time_plane() const {
+    std::vector<float> plane(map_cells, std::numeric_limits<float>::infinity());
+    for (std::size_t k = 0; k < cells.size(); ++k)
+      plane[cells[k]] = times[k];
+    return plane;
+  }
+};
+
+// The cells reachable from source within budget, source included.  Empty if
+// source is a barrier.
+inline void reachable_within(const maze& m, vertex_descriptor source, distance budget, search_scratch& scratch,
+                             isochrone& result) {
+  const std::size_t src = m.index(source);
+  result.map_cells = m.num_cells();
+  result.reached.assign((m.num_cells() + 63)/64, 0);
+  result.cells.clear();
+  result.times.clear();
+  scratch.reset(m.num_cells());
+  if (!m.passable(src) || !(budget >= 0))
+    return;
+
+  open_list open;
+  scratch.set(src, 0, src);
+  open.push(open_entry(0, uint32_t(src)));
+  while (!open.empty()) {
+    open_entry top = open.top();
+    open.pop();
+    std::size_t u = top.second;
+    if (scratch.closed(u))
+      continue;
+    scratch.close(u);
+    result.reached[u >> 6] |= uint64_t(1) << (u & 63);
+    result.cells.push_back(uint32_t(u));
+    result.times.push_back(float(top.first));
+    m.for_each_edge(u, [&](std::size_t v, double w) {
+      double d = top.first + w;
+      if (d <= budget && d < scratch.dist(v)) {
+        scratch.set(v, d, u);
+        open.push(open_entry(d, uint32_t(v)));
+      }
+    });
+  }
+}
+
+#endif
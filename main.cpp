@@ -7,8 +7,11 @@
 #include <stdio.h>
 #include <utility>
 #include <vector>
+#include <thread>
+#include <string>
 
 #include "utility.hpp"
+#include "isochrone.hpp"
 
 
 
@@ -39,35 +42,61 @@ std::vector<uint8_t> loadFile(const char* fileName, size_t expectedFileSize)
     return data;
 }
 
-bool donut(int x, int y, int x1, int y1)
-{
-    int dx = x - x1;
-    int dy = y - y1;
-    int r2 = dx * dx + dy * dy;
-    return r2 >= 150 && r2 <= 400;
-}
-
 int main(int argc, char** argv)
 {
     printf("%s\n", argv[0]);
+
+    // With --trace, what the first search explored is also drawn into search.bmp.
+    // --stats and --chrome-trace write per-query statistics and phase timings.
+    // --isochrone <minutes> draws where the rover can get within that time into
+    // isochrone.bmp.
+    bool traceSearch = false;
+    double isochroneMinutes = 0;
+    std::string statsPath, chromeTracePath;
+    for (int a = 1; a < argc; ++a)
+    {
+        std::string arg = argv[a];
+        if (arg == "--trace")
+            traceSearch = true;
+        else if (arg == "--stats" && a + 1 < argc)
+            statsPath = argv[++a];
+        else if (arg == "--chrome-trace" && a + 1 < argc)
+            chromeTracePath = argv[++a];
+        else if (arg == "--isochrone" && a + 1 < argc)
+            isochroneMinutes = atof(argv[++a]);
+    }
+    search_stats statsStore;
+    search_stats* stats = !statsPath.empty() || !chromeTracePath.empty() ? &statsStore : nullptr;
     
     const size_t expectedFileSize = IMAGE_DIM * IMAGE_DIM;
-    auto elevation = loadFile("assets/elevation.data", expectedFileSize);
-    auto overrides = loadFile("assets/overrides.data", expectedFileSize);
+    std::vector<uint8_t> elevation, overrides;
+    {
+        stats_phase phase(stats, "load");
+        elevation = loadFile("assets/elevation.data", expectedFileSize);
+        overrides = loadFile("assets/overrides.data", expectedFileSize);
+    }
     std::ofstream of("pic.bmp");
     
+    stats_phase buildPhase(stats, "map build");
     maze m = make_maze(IMAGE_DIM, IMAGE_DIM, overrides, elevation);
+    buildPhase.stop();
+    std::cout << std::endl << "Number of non-traversable cells: " << m.num_barriers() << std::endl;
          
     vertex_descriptor roverPos = vertex((ROVER_X+ROVER_Y*IMAGE_DIM), m.m_grid);
     vertex_descriptor humanPos = vertex((BACHELOR_X+BACHELOR_Y*IMAGE_DIM), m.m_grid);
     vertex_descriptor weddingPos = vertex((WEDDING_X+WEDDING_Y*IMAGE_DIM), m.m_grid);
 
-    if (m.solve(roverPos, humanPos))
+    search_trace trace;
+
+    if (m.solve(roverPos, humanPos, traceSearch ? &trace : nullptr, stats))
         std::cout << "Rover has reached the bachelor!" << std::endl;
     else
         std::cout << "Rover cacn't reach the bachelor." << std::endl;
 
-    std::set<std::pair<size_t, size_t>> path1;
+    // Water below, paths and markers on top
+    visualizer::Overlay water(IMAGE_DIM, IMAGE_DIM);
+    visualizer::Overlay marks(IMAGE_DIM, IMAGE_DIM);
+    water.drawWhere([&] (size_t i) { return !m.passable(i); }, visualizer::IPV_WATER);
     
     double pathTime1 = 0;
     for(auto elem = m.m_solution.begin(); elem != m.m_solution.end(); ++elem)
@@ -75,9 +104,8 @@ int main(int argc, char** argv)
         
         if(std::next(elem,1) != m.m_solution.end())
             pathTime1 += m.timeWeight(*elem, *std::next(elem,1), elevation);
-
-        path1.insert(std::make_pair(elem->at(0), elem->at(1)));
     }
+    marks.drawPoints(m.m_solution.begin(), m.m_solution.end(), visualizer::IPV_PATH);
 
     std::cout << "Time taken by rover to reach the bachelor is " << pathTime1 << " island seconds."<<std::endl;
     std::cout<<std::endl;
@@ -85,22 +113,19 @@ int main(int argc, char** argv)
 
 
     //Wedding party -> Bachelor to Wedding
-    if (m.solve(humanPos, weddingPos))
+    if (m.solve(humanPos, weddingPos, nullptr, stats))
         std::cout << "The bachelor has reached his wedding!" << std::endl;
     else
         std::cout << "Looks like the bachelor stays a bachelor for a while longer." << std::endl;
 
-    std::set<std::pair<size_t, size_t>> path2;
-
     double pathTime2 = 0;
     for(auto elem = m.m_solution.begin(); elem != m.m_solution.end(); ++elem)
     {
 
         if(std::next(elem,1) != m.m_solution.end())
             pathTime2 += m.timeWeight(*elem, *std::next(elem,1), elevation);
-
-        path2.insert(std::make_pair(elem->at(0), elem->at(1)));
     }
+    marks.drawPoints(m.m_solution.begin(), m.m_solution.end(), visualizer::IPV_PATH);
 
     std::cout << "Time taken by the rover to reach the wedding from the bachelor's position is " << pathTime2 << " island seconds."<<std::endl;
     std::cout<<std::endl;
@@ -116,40 +141,65 @@ int main(int argc, char** argv)
     std::cout << "You can open the map with $feh pic.bmp or $edisplay pic.bmp on Linux systems." <<std::endl;
 
 
+    // Marks interesting positions on the map
+    marks.stampDonut(ROVER_X, ROVER_Y, 150, 400, visualizer::IPV_PATH);
+    marks.stampDonut(BACHELOR_X, BACHELOR_Y, 150, 400, visualizer::IPV_PATH);
+    marks.stampDonut(WEDDING_X, WEDDING_Y, 150, 400, visualizer::IPV_PATH);
+
+    stats_phase renderPhase(stats, "render");
     visualizer::writeBMP(
         of,
         &elevation[0],
         IMAGE_DIM,
         IMAGE_DIM,
-        [&] (size_t x, size_t y, uint8_t elevation) {
-            
-            //Path
-            //if(std::find(path1.begin(), path1.end(), std::make_pair(x,y)) != path1.end())
-            //{
-            //    return uint8_t(visualizer::IPV_PATH);
-            //}
-            // Marks interesting positions on the map
-            if (donut(x, y, ROVER_X, ROVER_Y) ||
-                donut(x, y, BACHELOR_X, BACHELOR_Y) ||
-                donut(x, y, WEDDING_X, WEDDING_Y) || path1.find(std::make_pair(x,y)) != path1.end()|| path2.find(std::make_pair(x,y)) != path2.end())
-            {
-                return uint8_t(visualizer::IPV_PATH);
-            }
-            
-            // Signifies water
-            if ((overrides[y * IMAGE_DIM + x] & (OF_WATER_BASIN | OF_RIVER_MARSH)) ||
-                elevation == 0)
-            {
-                return uint8_t(visualizer::IPV_WATER);
-            }
-            
-            // Signifies normal ground color
-            if (elevation < visualizer::IPV_ELEVATION_BEGIN)
-            {
-                elevation = visualizer::IPV_ELEVATION_BEGIN;
-            }
-            return elevation;
-    });
+        {&water, &marks},
+        std::thread::hardware_concurrency());
+
+    if (traceSearch)
+    {
+        std::ofstream traceOut("search.bmp");
+        auto expansions = trace.expansion_plane();
+        visualizer::writeHeatmapBMP(
+            traceOut,
+            &expansions[0],
+            IMAGE_DIM,
+            IMAGE_DIM,
+            {&water, &marks},
+            std::thread::hardware_concurrency());
+        std::cout << "Expanded " << trace.expansions << " cells, see search.bmp." << std::endl;
+    }
+    if (isochroneMinutes > 0)
+    {
+        // Contours every quarter of the budget, the outermost at the budget
+        search_scratch scratch;
+        isochrone reach;
+        reachable_within(m, roverPos, isochroneMinutes * 60, scratch, reach);
+        visualizer::Overlay contours(IMAGE_DIM, IMAGE_DIM);
+        auto times = reach.time_plane();
+        contours.drawContours(&times[0], float(isochroneMinutes * 15), visualizer::IPV_PATH);
+        std::ofstream isochroneOut("isochrone.bmp");
+        visualizer::writeBMP(
+            isochroneOut,
+            &elevation[0],
+            IMAGE_DIM,
+            IMAGE_DIM,
+            {&water, &contours},
+            std::thread::hardware_concurrency());
+        std::cout << "The rover can reach " << reach.cells.size() << " cells within " << isochroneMinutes
+                  << " island minutes, see isochrone.bmp." << std::endl;
+    }
+    renderPhase.stop();
+
+    if (!statsPath.empty())
+    {
+        std::ofstream statsOut(statsPath.c_str());
+        statsStore.write_json(statsOut);
+    }
+    if (!chromeTracePath.empty())
+    {
+        std::ofstream traceOut(chromeTracePath.c_str());
+        statsStore.write_chrome_trace(traceOut);
+    }
     //system("edisplay pic.bmp");
     return 0;
 }
@@ -0,0 +1,202 @@
+#ifndef MAP_BUILD_HPP
+#define MAP_BUILD_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "cell_memory.hpp"
+
+// Building blocks for make_maze: cell classification into a passable
+// bitmap, and connected-component labelling over runs of passable cells.
+
+namespace detail {
+
+inline unsigned popcount64(uint64_t v) {
+#if defined(__GNUC__)
+  return unsigned(__builtin_popcountll(v));
+#else
+  unsigned n = 0;
+  for (; v; v &= v - 1)
+    ++n;
+  return n;
+#endif
+}
+
+// Position of the lowest set bit of a non-zero word.
+inline unsigned lowestBit64(uint64_t v) {
+#if defined(__GNUC__)
+  return unsigned(__builtin_ctzll(v));
+#else
+  unsigned n = 0;
+  for (; !(v & 1); v >>= 1)
+    ++n;
+  return n;
+#endif
+}
+
+// OR the low width bits of value into the bitmap at bit position pos.
+inline void orBits(uint64_t* bits, std::size_t pos, uint64_t value, unsigned width) {
+  const unsigned offset = unsigned(pos & 63);
+  bits[pos >> 6] |= value << offset;
+  if (offset + width > 64)
+    bits[(pos >> 6) + 1] |= value >> (64 - offset);
+}
+
+// Classify n cells.  A cell is passable unless its override has a bit of
+// blockMask set or its elevation is zero.  Writes 1/0 per cell to pass and,
+// if bits is given, ORs the passable bits into it starting at bit position
+// pos.  Returns the number of impassable cells.
+inline std::size_t classifyRow(const uint8_t* overrides, const uint8_t* elevation, std::size_t n,
+                               uint8_t blockMask, uint8_t* pass, uint64_t* bits, std::size_t pos) {
+  std::size_t x = 0, passable = 0;
+#if defined(__AVX2__)
+  const __m256i mask = _mm256_set1_epi8(char(blockMask));
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi8(1);
+  for (; x + 32 <= n; x += 32) {
+    __m256i o = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(overrides + x));
+    __m256i e = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(elevation + x));
+    __m256i ok = _mm256_andnot_si256(_mm256_cmpeq_epi8(e, zero),
+                                     _mm256_cmpeq_epi8(_mm256_and_si256(o, mask), zero));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(pass + x), _mm256_and_si256(ok, one));
+    uint64_t m = uint32_t(_mm256_movemask_epi8(ok));
+    if (bits)
+      orBits(bits, pos + x, m, 32);
+    passable += popcount64(m);
+  }
+#elif defined(__SSE2__)
+  const __m128i mask = _mm_set1_epi8(char(blockMask));
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi8(1);
+  for (; x + 16 <= n; x += 16) {
+    __m128i o = _mm_loadu_si128(reinterpret_cast<const __m128i*>(overrides + x));
+    __m128i e = _mm_loadu_si128(reinterpret_cast<const __m128i*>(elevation + x));
+    __m128i ok = _mm_andnot_si128(_mm_cmpeq_epi8(e, zero), _mm_cmpeq_epi8(_mm_and_si128(o, mask), zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(pass + x), _mm_and_si128(ok, one));
+    uint64_t m = uint32_t(_mm_movemask_epi8(ok));
+    if (bits)
+      orBits(bits, pos + x, m, 16);
+    passable += popcount64(m);
+  }
+#endif
+  for (; x < n; ++x) {
+    pass[x] = (overrides[x] & blockMask) == 0 && elevation[x] != 0;
+    if (pass[x]) {
+      ++passable;
+      if (bits)
+        orBits(bits, pos + x, 1, 1);
+    }
+  }
+  return n - passable;
+}
+
+// A horizontal run [begin, end) of passable cells in one row.
+struct cell_run {
+  uint32_t row;
+  uint32_t begin;
+  uint32_t end;
+};
+
+// Union-find over run ids with path halving; the smaller id becomes the root
+// so that roots are stable when sets from different bands are joined.
+class run_union_find {
+public:
+  uint32_t add() {
+    m_parent.push_back(uint32_t(m_parent.size()));
+    return m_parent.back();
+  }
+  // Append another structure's sets, shifting its ids by the current size.
+  void append(const run_union_find& other) {
+    const uint32_t offset = uint32_t(m_parent.size());
+    for (uint32_t p : other.m_parent)
+      m_parent.push_back(p + offset);
+  }
+  uint32_t find(uint32_t a) {
+    while (m_parent[a] != a) {
+      m_parent[a] = m_parent[m_parent[a]];
+      a = m_parent[a];
+    }
+    return a;
+  }
+  void unite(uint32_t a, uint32_t b) {
+    a = find(a);
+    b = find(b);
+    if (a < b)
+      m_parent[b] = a;
+    else if (b < a)
+      m_parent[a] = b;
+  }
+  std::size_t size() const {return m_parent.size();}
+
+private:
+  std::vector<uint32_t> m_parent;
+};
+
+// Join runs[a0, a1) of one row with the 4-adjacent runs[b0, b1) of the next:
+// two runs touch when their column ranges overlap.  firstId is the id of
+// runs[0] in sets.
+inline void joinRows(const std::vector<cell_run>& runs, std::size_t a0, std::size_t a1,
+                     std::size_t b0, std::size_t b1, uint32_t firstId, run_union_find& sets) {
+  while (a0 < a1 && b0 < b1) {
+    if (runs[a0].begin < runs[b0].end && runs[b0].begin < runs[a0].end)
+      sets.unite(firstId + uint32_t(a0), firstId + uint32_t(b0));
+    if (runs[a0].end < runs[b0].end)
+      ++a0;
+    else
+      ++b0;
+  }
+}
+
+// Append the runs of one row of passable bytes to runs.
+inline void appendRuns(const uint8_t* pass, std::size_t n, uint32_t row, std::vector<cell_run>& runs) {
+  std::size_t x = 0;
+  while (x < n) {
+    while (x < n && !pass[x])
+      ++x;
+    std::size_t begin = x;
+    while (x < n && pass[x])
+      ++x;
+    if (x > begin) {
+      cell_run r = {row, uint32_t(begin), uint32_t(x)};
+      runs.push_back(r);
+    }
+  }
+}
+
+// First position in [pos, end) of a bitmap whose bit equals value, or end.
+// Skips whole words of the other value at a time.
+inline std::size_t findBit(const uint64_t* bits, std::size_t pos, std::size_t end, bool value) {
+  while (pos < end) {
+    uint64_t word = value ? bits[pos >> 6] : ~bits[pos >> 6];
+    word &= ~uint64_t(0) << (pos & 63);
+    if (word)
+      return std::min(end, (pos & ~std::size_t(63)) + lowestBit64(word));
+    pos = (pos | 63) + 1;
+  }
+  return end;
+}
+
+// Append the runs of set bits in [pos, pos + n) of a bitmap to runs, with
+// columns relative to pos.
+inline void appendBitRuns(const uint64_t* bits, std::size_t pos, std::size_t n, uint32_t row,
+                          std::vector<cell_run>& runs) {
+  const std::size_t end = pos + n;
+  for (std::size_t i = findBit(bits, pos, end, true); i < end; i = findBit(bits, i, end, true)) {
+    std::size_t j = findBit(bits, i, end, false);
+    cell_run r = {row, uint32_t(i - pos), uint32_t(j - pos)};
+    runs.push_back(r);
+    i = j;
+  }
+}
+
+} // namespace detail
+
+#endif
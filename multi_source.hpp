@@ -0,0 +1,94 @@
+#ifndef MULTI_SOURCE_HPP
+#define MULTI_SOURCE_HPP
+
+#include <cstddef>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+#include "search_scratch.hpp"
+#include "utility.hpp"
+
+// One search from many sources to a single goal.
+//
+// Dispatching the closest of N rovers would otherwise take N searches to the
+// same goal.  Here every source is seeded into one open list with its start
+// offset as its initial cost, the time at which that rover can set off.  The
+// search is A* towards the goal and stops when the goal is settled, so the
+// source it was reached from is the one that arrives first.
+
+struct search_source {
+  vertex_descriptor cell;
+  // Time before this source can start moving
+  distance offset;
+};
+
+struct multi_source_result {
+  // Index of the winning source in the sources given
+  std::size_t source;
+  // Arrival time at the goal, the winner's offset included
+  distance arrival;
+  // The winner's path, source first
+  std::vector<vertex_descriptor> path;
+};
+
+// Search from all sources at once.  Returns false if no source can reach
+// goal.  Sources on barriers or on another island are ignored.  Where two
+// sources share a cell the earlier offset wins, then the lower index.
+inline bool multi_source_solve(const maze& m, const std::vector<search_source>& sources, vertex_descriptor goal,
+                               search_scratch& scratch, multi_source_result& result,
+                               std::size_t* expansions = nullptr) {
+  const std::size_t dst = m.index(goal);
+  std::size_t expanded = 0;
+  scratch.reset(m.num_cells());
+
+  auto heuristic = [&](std::size_t i) {
+    vertex_descriptor u = m.cell(i);
+    return double(std::abs(long(u[0]) - long(goal[0])) + std::abs(long(u[1]) - long(goal[1])));
+  };
+  open_list open;
+  for (const search_source& s : sources) {
+    const std::size_t src = m.index(s.cell);
+    if (!m.connected(src, dst) || !(s.offset < scratch.dist(src)))
+      continue;
+    scratch.set(src, s.offset, src);
+    open.push(open_entry(s.offset + heuristic(src), uint32_t(src)));
+  }
+  while (!open.empty()) {
+    std::size_t u = open.top().second;
+    open.pop();
+    if (scratch.closed(u))
+      continue;
+    scratch.close(u);
+    ++expanded;
+    if (u == dst)
+      break;
+    const distance gu = scratch.dist(u);
+    m.for_each_edge(u, [&](std::size_t v, double w) {
+      distance d = gu + w;
+      if (d < scratch.dist(v)) {
+        scratch.set(v, d, u);
+        open.push(open_entry(d + heuristic(v), uint32_t(v)));
+      }
+    });
+  }
+  if (expansions)
+    *expansions = expanded;
+  if (!scratch.closed(dst))
+    return false;
+
+  // The predecessor chain ends at a seed, which is its own predecessor
+  std::size_t root = dst;
+  while (scratch.pred(root) != root)
+    root = scratch.pred(root);
+  result.arrival = scratch.dist(dst);
+  result.path = scratch.path(m, root, dst);
+  result.source = sources.size();
+  for (std::size_t k = 0; k < sources.size(); ++k)
+    if (m.index(sources[k].cell) == root &&
+        (result.source == sources.size() || sources[k].offset < sources[result.source].offset))
+      result.source = k;
+  return true;
+}
+
+#endif
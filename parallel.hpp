@@ -0,0 +1,65 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Number of worker threads to use when the caller does not say.
+inline unsigned default_threads() {
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Run f(t) for t in [0, threads), each on its own thread.  The calling
+// thread runs t == 0 itself.
+template <typename F>
+void parallel_invoke(unsigned threads, F f) {
+  std::vector<std::thread> workers;
+  for (unsigned t = 1; t < threads; ++t)
+    workers.emplace_back(f, t);
+  f(0u);
+  for (std::thread& worker : workers)
+    worker.join();
+}
+
+// Split [begin, end) into one contiguous block per thread and run
+// f(first, last, t) on each.
+template <typename F>
+void parallel_for(std::size_t begin, std::size_t end, unsigned threads, F f) {
+  threads = unsigned(std::max<std::size_t>(1, std::min<std::size_t>(threads, end - begin)));
+  parallel_invoke(threads, [&](unsigned t) {
+    std::size_t first = begin + (end - begin)*t/threads;
+    std::size_t last = begin + (end - begin)*(t + 1)/threads;
+    f(first, last, t);
+  });
+}
+
+// Reusable barrier for a fixed number of threads.
+class thread_barrier {
+public:
+  explicit thread_barrier(unsigned threads):m_threads(threads),m_waiting(0),m_generation(0) {};
+
+  void wait() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    unsigned generation = m_generation;
+    if (++m_waiting == m_threads) {
+      m_waiting = 0;
+      ++m_generation;
+      m_cv.notify_all();
+      return;
+    }
+    m_cv.wait(lock, [&] {return generation != m_generation;});
+  }
+
+private:
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  unsigned m_threads;
+  unsigned m_waiting;
+  unsigned m_generation;
+};
+
+#endif
@@ -0,0 +1,302 @@
+#ifndef PATH_DATABASE_HPP
+#define PATH_DATABASE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PATH_DATABASE_HAS_MMAP
+#endif
+
+#include "compact_index.hpp"
+#include "parallel.hpp"
+#include "search_scratch.hpp"
+#include "utility.hpp"
+
+// Compressed path databases for a fixed set of depots.
+//
+// For every depot the database holds the first move towards it from every
+// traversable cell.  A depot query then follows first moves cell by cell,
+// in time proportional to the path and with no search.  Moves are listed in
+// compact_index order, row-major over the traversable cells, and
+// run-length encoded.  Each run is one 32-bit word: the compact id where it
+// starts, shifted left by two, over the move.  Cells that cannot reach the
+// depot take the move of the run they fall in, and so do the depots
+// themselves.  Where several first moves are optimal the encoder keeps the
+// current run's move, so runs stay long.
+//
+// The file is a header, a table with each depot's cell and first run, and
+// the runs, all 8-byte aligned.  It is mapped read-only as a whole.
+
+struct path_database_header {
+  char magic[4];          // "FPCD"
+  uint32_t version;
+  uint64_t width;
+  uint64_t height;
+  // Traversable cells, the length of the compact ordering
+  uint64_t cells;
+  uint64_t depots;
+  uint64_t runs;
+};
+
+struct path_database_depot {
+  uint32_t cell;
+  uint32_t reserved;
+  // Index of the depot's first run; the next entry's marks the end
+  uint64_t first_run;
+};
+
+// First moves
+enum {PDB_WEST = 0, PDB_EAST = 1, PDB_NORTH = 2, PDB_SOUTH = 3};
+
+namespace detail {
+
+// The move from cell i to its 4-neighbour n
+inline uint32_t moveTowards(std::size_t i, std::size_t n) {
+  if (n + 1 == i) return PDB_WEST;
+  if (n == i + 1) return PDB_EAST;
+  return n < i ? PDB_NORTH : PDB_SOUTH;
+}
+
+// Run-length encode the first moves towards depot from a Dijkstra run
+// rooted there.  A cell's first move goes to a neighbour that realises its
+// distance, the current run's move if that one does.
+inline void encodeFirstMoves(const maze& m, const compact_index& index, std::size_t depot,
+                             const search_scratch& s, std::vector<uint32_t>& runs) {
+  uint32_t current = 4;
+  for (uint32_t id = 0; id < index.size(); ++id) {
+    const std::size_t i = index.cell(id);
+    if (i == depot || !s.reached(i))
+      continue;
+    const double d = s.dist(i);
+    uint32_t move = 4;
+    m.for_each_edge(i, [&](std::size_t n, double c) {
+      if (s.dist(n) + c == d) {
+        uint32_t candidate = moveTowards(i, n);
+        if (move == 4 || candidate == current)
+          move = candidate;
+      }
+    });
+    if (move != current) {
+      runs.push_back((runs.empty() ? 0 : id << 2) | move);
+      current = move;
+    }
+  }
+  if (runs.empty())
+    runs.push_back(0);
+}
+
+} // namespace detail
+
+// Build the database for the given depots and write it to path.  Depots are
+// handed out to the threads through a shared counter; each runs a full
+// Dijkstra from its depot (costs are symmetric, so distances to the depot
+// equal distances from it) with its own search_scratch.  Barrier depots get
+// an empty entry.
+inline bool build_path_database(const maze& m, const std::vector<vertex_descriptor>& depots, const char* path,
+                         unsigned threads = default_threads()) {
+  const compact_index index(m, threads);
+  std::vector<std::vector<uint32_t> > runs(depots.size());
+  std::atomic<std::size_t> next(0);
+  threads = unsigned(std::max<std::size_t>(1, std::min<std::size_t>(threads, depots.size())));
+  parallel_invoke(threads, [&](unsigned) {
+    search_scratch s;
+    open_list open;
+    std::size_t k;
+    while ((k = next.fetch_add(1)) < depots.size()) {
+      const std::size_t src = m.index(depots[k]);
+      if (!m.passable(src))
+        continue;
+      s.reset(m.num_cells());
+      open = open_list();
+      s.set(src, 0, src);
+      open.push(open_entry(0, uint32_t(src)));
+      while (!open.empty()) {
+        open_entry top = open.top();
+        open.pop();
+        std::size_t u = top.second;
+        if (s.closed(u))
+          continue;
+        s.close(u);
+        m.for_each_edge(u, [&](std::size_t v, double w) {
+          double d = top.first + w;
+          if (d < s.dist(v)) {
+            s.set(v, d, u);
+            open.push(open_entry(d, uint32_t(v)));
+          }
+        });
+      }
+      detail::encodeFirstMoves(m, index, src, s, runs[k]);
+    }
+  });
+
+  path_database_header header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, "FPCD", 4);
+  header.version = 1;
+  header.width = m.length(0);
+  header.height = m.length(1);
+  header.cells = index.size();
+  header.depots = depots.size();
+  std::vector<path_database_depot> table(depots.size() + 1);
+  for (std::size_t k = 0; k < depots.size(); ++k) {
+    table[k].cell = uint32_t(m.index(depots[k]));
+    table[k].reserved = 0;
+    table[k].first_run = header.runs;
+    header.runs += runs[k].size();
+  }
+  table[depots.size()].cell = 0;
+  table[depots.size()].reserved = 0;
+  table[depots.size()].first_run = header.runs;
+
+  std::ofstream out(path, std::ofstream::binary);
+  out.write((const char*)&header, sizeof(header));
+  out.write((const char*)&table[0], table.size()*sizeof(path_database_depot));
+  for (const std::vector<uint32_t>& r : runs)
+    if (!r.empty())
+      out.write((const char*)&r[0], r.size()*sizeof(uint32_t));
+  return out.good();
+}
+
+// Read access to a path database file, mapped read-only.
+class path_database {
+public:
+  path_database():m_data(nullptr),m_bytes(0),m_maze(nullptr),m_table(nullptr),m_runs(nullptr) {};
+  ~path_database() {close();}
+  path_database(const path_database&) = delete;
+  path_database& operator=(const path_database&) = delete;
+
+  // Open a database built for m.  Fails if the file is not one, or was
+  // built for another map.  The maze must outlive the database.
+  bool open(const char* path, const maze& m);
+  void close();
+
+  std::size_t num_depots() const {return m_data ? std::size_t(header().depots) : 0;}
+  vertex_descriptor depot(std::size_t k) const {return m_maze->cell(m_table[k].cell);}
+  std::size_t num_runs() const {return m_data ? std::size_t(header().runs) : 0;}
+  std::size_t file_bytes() const {return m_bytes;}
+
+  // The first move from cell i towards depot k, one of the PDB_ moves.
+  // Meaningless if i cannot reach the depot.
+  uint32_t first_move(std::size_t k, std::size_t i) const {
+    const uint32_t* first = m_runs + m_table[k].first_run;
+    const uint32_t* last = m_runs + m_table[k + 1].first_run;
+    const uint32_t key = (m_index.id(i) << 2) | 3;
+    return *(std::upper_bound(first, last, key) - 1) & 3;
+  }
+
+  // Path from start to depot k by following first moves, and its travel
+  // time.  Returns false if start cannot reach the depot.
+  bool path_to(std::size_t k, vertex_descriptor start, std::vector<vertex_descriptor>& path,
+               distance& length) const {
+    const std::size_t w = m_maze->length(0);
+    const std::size_t goal = m_table[k].cell;
+    std::size_t i = m_maze->index(start);
+    path.clear();
+    length = 0;
+    if (m_table[k].first_run == m_table[k + 1].first_run || !m_maze->connected(i, goal))
+      return false;
+    path.push_back(start);
+    // A database that does not match the map could send us in circles
+    for (std::size_t steps = 0; i != goal; ++steps) {
+      if (steps == m_index.size())
+        return false;
+      std::size_t n;
+      switch (first_move(k, i)) {
+      case PDB_WEST: n = i - 1; break;
+      case PDB_EAST: n = i + 1; break;
+      case PDB_NORTH: n = i - w; break;
+      default: n = i + w; break;
+      }
+      length += m_maze->stepCost(i, n);
+      i = n;
+      path.push_back(m_maze->cell(i));
+    }
+    return true;
+  }
+
+private:
+  const path_database_header& header() const {return *(const path_database_header*)m_data;}
+
+  const char* m_data;
+  std::size_t m_bytes;
+  const maze* m_maze;
+  compact_index m_index;
+  const path_database_depot* m_table;
+  const uint32_t* m_runs;
+#ifndef PATH_DATABASE_HAS_MMAP
+  std::vector<char> m_copy;
+#endif
+};
+
+
+inline bool path_database::open(const char* path, const maze& m) {
+  close();
+#ifdef PATH_DATABASE_HAS_MMAP
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || std::size_t(st.st_size) < sizeof(path_database_header)) {
+    ::close(fd);
+    return false;
+  }
+  m_bytes = std::size_t(st.st_size);
+  void* data = mmap(nullptr, m_bytes, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    m_bytes = 0;
+    return false;
+  }
+  m_data = (const char*)data;
+#else
+  std::ifstream in(path, std::ifstream::binary | std::ifstream::ate);
+  if (!in.good())
+    return false;
+  m_copy.resize(std::size_t(in.tellg()));
+  in.seekg(0);
+  in.read(&m_copy[0], m_copy.size());
+  if (!in.good() || m_copy.size() < sizeof(path_database_header))
+    return false;
+  m_bytes = m_copy.size();
+  m_data = &m_copy[0];
+#endif
+  m_maze = &m;
+  m_index = compact_index(m, 1);
+  const path_database_header& h = header();
+  const std::size_t tableBytes = std::size_t(h.depots + 1)*sizeof(path_database_depot);
+  if (std::memcmp(h.magic, "FPCD", 4) != 0 || h.version != 1 || h.width != m.length(0) ||
+      h.height != m.length(1) || h.cells != m_index.size() ||
+      m_bytes != sizeof(h) + tableBytes + std::size_t(h.runs)*sizeof(uint32_t)) {
+    close();
+    return false;
+  }
+  m_table = (const path_database_depot*)(m_data + sizeof(h));
+  m_runs = (const uint32_t*)(m_data + sizeof(h) + tableBytes);
+  return true;
+}
+
+inline void path_database::close() {
+#ifdef PATH_DATABASE_HAS_MMAP
+  if (m_data)
+    munmap((void*)m_data, m_bytes);
+#else
+  m_copy.clear();
+#endif
+  m_data = nullptr;
+  m_bytes = 0;
+  m_maze = nullptr;
+  m_table = nullptr;
+  m_runs = nullptr;
+}
+
+#endif
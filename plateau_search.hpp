@@ -0,0 +1,215 @@
+#ifndef PLATEAU_SEARCH_HPP
+#define PLATEAU_SEARCH_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "cell_memory.hpp"
+#include "search_scratch.hpp"
+#include "utility.hpp"
+
+// Shortest paths that jump across plateaus of equal elevation.
+//
+// A step between two cells of equal elevation costs stepTime(0) == 1.  On a
+// plateau the grid is therefore uniform, and A* expands each of the many
+// equal-cost orderings of the same moves.  This search uses rectangular
+// symmetry reduction, a relative of jump point search.  The map is cut into
+// rectangles of passable cells that share one elevation.  Inside a
+// rectangle, any two cells are joined by a monotone path that costs their
+// Manhattan distance.  The search therefore never enters a rectangle.  It
+// expands only perimeter cells, which step to their grid neighbours at the
+// usual edge-plane costs and jump straight across to the opposite side.
+// Where elevation changes the rectangles are single cells, and the search is
+// ordinary A*.
+//
+// Why this stays optimal: take an optimal path and any piece of it inside
+// one rectangle, from perimeter cell a to perimeter cell b.  It costs at
+// least their Manhattan distance.  The perimeter cells and crossings also
+// join a and b at that cost.  For adjacent sides the route turns at the
+// corner.  For opposite sides it crosses on a's row or column and then runs
+// along b's side.  An interior source reaches the perimeter through its four
+// straight projections.  An interior goal is reached straight from any cell
+// of its own rectangle.  Every edge costs at least the Manhattan distance it
+// covers, so the Manhattan heuristic stays consistent.
+
+// Cells [x0, x1) x [y0, y1)
+struct plateau_rect {
+  uint32_t x0, y0, x1, y1;
+};
+
+// Rectangle id of a barrier cell
+const uint32_t kNoRect = uint32_t(-1);
+
+class plateau_search {
+public:
+  // The maze must outlive the search.  Rectangles are grown greedily in row
+  // order: the largest square at the first free cell, then wider and then
+  // taller while whole columns and rows still fit.
+  explicit plateau_search(const maze& m):m_maze(m), m_width(m.length(0)), m_height(m.length(1)) {
+    const std::size_t w = m_width, h = m_height;
+    m_rect.assign(m.num_cells(), kNoRect);
+    m_interior.assign(m.num_cells(), 0);
+    for (std::size_t y = 0; y < h; ++y)
+      for (std::size_t x = 0; x < w; ++x) {
+        const std::size_t i = x + y*w;
+        if (!m.passable(i) || m_rect[i] != kNoRect)
+          continue;
+        const uint8_t e = m.m_elev[i];
+        auto joins = [&](std::size_t cx, std::size_t cy) {
+          const std::size_t c = cx + cy*w;
+          return m_rect[c] == kNoRect && m.passable(c) && m.m_elev[c] == e;
+        };
+        auto columnJoins = [&](std::size_t cx, std::size_t y0, std::size_t y1) {
+          for (std::size_t cy = y0; cy < y1; ++cy)
+            if (!joins(cx, cy))
+              return false;
+          return true;
+        };
+        auto rowJoins = [&](std::size_t cy, std::size_t x0, std::size_t x1) {
+          for (std::size_t cx = x0; cx < x1; ++cx)
+            if (!joins(cx, cy))
+              return false;
+          return true;
+        };
+        std::size_t x1 = x + 1, y1 = y + 1;
+        while (x1 < w && y1 < h && columnJoins(x1, y, y1) && rowJoins(y1, x, x1 + 1)) {
+          ++x1;
+          ++y1;
+        }
+        while (x1 < w && columnJoins(x1, y, y1))
+          ++x1;
+        while (y1 < h && rowJoins(y1, x, x1))
+          ++y1;
+
+        const uint32_t id = uint32_t(m_rects.size());
+        plateau_rect r = {uint32_t(x), uint32_t(y), uint32_t(x1), uint32_t(y1)};
+        m_rects.push_back(r);
+        for (std::size_t ry = y; ry < y1; ++ry) {
+          std::fill(&m_rect[x + ry*w], &m_rect[x + ry*w] + (x1 - x), id);
+          if (ry > y && ry + 1 < y1 && x1 - x > 2)
+            std::fill(&m_interior[x + 1 + ry*w], &m_interior[x1 - 1 + ry*w], uint8_t(1));
+        }
+      }
+  }
+
+  std::size_t num_rectangles() const {return m_rects.size();}
+  // Passable cells that are not on the perimeter of their rectangle
+  bool interior(std::size_t i) const {return m_interior[i] != 0;}
+
+  // Shortest path from source to goal under the edge cost planes.  Returns
+  // true and sets length if goal is reachable.  If path is given it receives
+  // every cell of the path, and if expansions is given the number of cells
+  // expanded.
+  bool solve(vertex_descriptor source, vertex_descriptor goal, search_scratch& scratch, distance& length,
+             std::vector<vertex_descriptor>* path = nullptr, std::size_t* expansions = nullptr) const {
+    const std::size_t src = m_maze.index(source);
+    const std::size_t dst = m_maze.index(goal);
+    std::size_t expanded = 0;
+    scratch.reset(m_maze.num_cells());
+    if (!m_maze.connected(src, dst))
+      return false;
+
+    auto manhattan = [&](std::size_t a, std::size_t b) {
+      return double(std::abs(long(a % m_width) - long(b % m_width)) +
+                    std::abs(long(a / m_width) - long(b / m_width)));
+    };
+    const bool goalInside = interior(dst);
+    open_list open;
+    std::size_t u;
+    auto relax = [&](std::size_t v, double d) {
+      if (d < scratch.dist(v)) {
+        scratch.set(v, d, u);
+        open.push(open_entry(d + manhattan(v, dst), uint32_t(v)));
+      }
+    };
+
+    scratch.set(src, 0, src);
+    open.push(open_entry(manhattan(src, dst), uint32_t(src)));
+    while (!open.empty()) {
+      u = open.top().second;
+      open.pop();
+      if (scratch.closed(u))
+        continue;
+      scratch.close(u);
+      ++expanded;
+      if (u == dst)
+        break;
+      const double gu = scratch.dist(u);
+      if (goalInside && m_rect[u] == m_rect[dst])
+        relax(dst, gu + manhattan(u, dst));
+      const plateau_rect& r = m_rects[m_rect[u]];
+      if (interior(u)) {
+        // Only the source: out to the four sides
+        const std::size_t x = u % m_width, y = u / m_width;
+        relax(r.x0 + y*m_width, gu + double(x - r.x0));
+        relax(r.x1 - 1 + y*m_width, gu + double(r.x1 - 1 - x));
+        relax(x + r.y0*m_width, gu + double(y - r.y0));
+        relax(x + (r.y1 - 1)*m_width, gu + double(r.y1 - 1 - y));
+        continue;
+      }
+      m_maze.for_each_edge(u, [&](std::size_t v, double c) {
+        if (!interior(v))
+          relax(v, gu + c);
+      });
+      // Across to the opposite side, where there is an interior to jump
+      if (r.x1 - r.x0 <= 2 && r.y1 - r.y0 <= 2)
+        continue;
+      const std::size_t x = u % m_width, y = u / m_width;
+      if (r.x1 - r.x0 > 2) {
+        if (x == r.x0)
+          relax(r.x1 - 1 + y*m_width, gu + double(r.x1 - 1 - r.x0));
+        else if (x + 1 == r.x1)
+          relax(r.x0 + y*m_width, gu + double(r.x1 - 1 - r.x0));
+      }
+      if (r.y1 - r.y0 > 2) {
+        if (y == r.y0)
+          relax(x + (r.y1 - 1)*m_width, gu + double(r.y1 - 1 - r.y0));
+        else if (y + 1 == r.y1)
+          relax(x + r.y0*m_width, gu + double(r.y1 - 1 - r.y0));
+      }
+    }
+    if (expansions)
+      *expansions = expanded;
+    if (!scratch.closed(dst))
+      return false;
+    length = scratch.dist(dst);
+    if (path)
+      *path = unpack(scratch, src, dst);
+    return true;
+  }
+
+private:
+  // Every cell of the path.  Consecutive cells of the search path lie in one
+  // row or column, or in one rectangle, so moving horizontally and then
+  // vertically between them stays on passable cells of the same elevation.
+  std::vector<vertex_descriptor> unpack(const search_scratch& scratch, std::size_t source, std::size_t goal) const {
+    std::vector<vertex_descriptor> jumps = scratch.path(m_maze, source, goal);
+    std::vector<vertex_descriptor> cells(1, jumps[0]);
+    for (std::size_t k = 1; k < jumps.size(); ++k) {
+      vertex_descriptor u = jumps[k - 1];
+      const vertex_descriptor& v = jumps[k];
+      while (u != v) {
+        if (u[0] != v[0])
+          u[0] = u[0] < v[0] ? u[0] + 1 : u[0] - 1;
+        else
+          u[1] = u[1] < v[1] ? u[1] + 1 : u[1] - 1;
+        cells.push_back(u);
+      }
+    }
+    return cells;
+  }
+
+  const maze& m_maze;
+  std::size_t m_width;
+  std::size_t m_height;
+  // Rectangle of every passable cell, kNoRect for barriers
+  cell_vector<uint32_t> m_rect;
+  // 1 for cells off their rectangle's perimeter
+  cell_vector<uint8_t> m_interior;
+  std::vector<plateau_rect> m_rects;
+};
+
+#endif
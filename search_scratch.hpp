@@ -0,0 +1,98 @@
+#ifndef SEARCH_SCRATCH_HPP
+#define SEARCH_SCRATCH_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "utility.hpp"
+
+// Open list entry: (key, cell index). Stale entries are skipped on pop.
+typedef std::pair<double, uint32_t> open_entry;
+typedef std::priority_queue<open_entry, std::vector<open_entry>,
+                            std::greater<open_entry> > open_list;
+
+// Flat per-cell search state that can be reused across queries.
+//
+// Instead of clearing the distance and predecessor arrays between searches,
+// each cell carries the epoch in which it was last written; bumping the epoch
+// invalidates the whole array in O(1).  A second stamp array tracks the closed
+// set, with its own epoch so that multi-pass searches can reopen cells.  Each
+// reached cell also carries a mark that searches can use for one bit of state
+// of their own; set() clears it.
+class search_scratch {
+public:
+  search_scratch():m_epoch(0),m_closed_epoch(0) {};
+
+  // Prepare for a new query over a map with the given number of cells.
+  void reset(std::size_t cells) {
+    if (m_stamp.size() != cells) {
+      m_dist.assign(cells, 0);
+      m_pred.assign(cells, 0);
+      m_mark.assign(cells, 0);
+      m_stamp.assign(cells, 0);
+      m_closed.assign(cells, 0);
+      m_epoch = 0;
+      m_closed_epoch = 0;
+    }
+    if (++m_epoch == 0) {
+      std::fill(m_stamp.begin(), m_stamp.end(), 0);
+      m_epoch = 1;
+    }
+    reset_closed();
+  }
+
+  // Empty the closed set only, keeping distances.
+  void reset_closed() {
+    if (++m_closed_epoch == 0) {
+      std::fill(m_closed.begin(), m_closed.end(), 0);
+      m_closed_epoch = 1;
+    }
+  }
+
+  bool reached(std::size_t i) const {return m_stamp[i] == m_epoch;}
+  double dist(std::size_t i) const {
+    return reached(i) ? m_dist[i] : std::numeric_limits<double>::infinity();
+  }
+  uint32_t pred(std::size_t i) const {return m_pred[i];}
+  void set(std::size_t i, double d, std::size_t p) {
+    m_stamp[i] = m_epoch;
+    m_dist[i] = d;
+    m_pred[i] = uint32_t(p);
+    m_mark[i] = 0;
+  }
+
+  // The mark of a cell set() in this query; false for any other cell.
+  bool marked(std::size_t i) const {return reached(i) && m_mark[i];}
+  void mark(std::size_t i, bool on = true) {m_mark[i] = on;}
+
+  bool closed(std::size_t i) const {return m_closed[i] == m_closed_epoch;}
+  void close(std::size_t i) {m_closed[i] = m_closed_epoch;}
+
+  // Walk the predecessor chain back from goal to source, returning the path
+  // in travel order.  Grid is a maze or any grid with the same cell interface.
+  template <typename Grid>
+  std::vector<vertex_descriptor> path(const Grid& m, std::size_t source, std::size_t goal) const {
+    std::vector<vertex_descriptor> result;
+    for (std::size_t u = goal; u != source; u = m_pred[u])
+      result.push_back(m.cell(u));
+    result.push_back(m.cell(source));
+    std::reverse(result.begin(), result.end());
+    return result;
+  }
+
+private:
+  cell_vector<double> m_dist;
+  cell_vector<uint32_t> m_pred;
+  cell_vector<uint8_t> m_mark;
+  cell_vector<uint32_t> m_stamp;
+  cell_vector<uint32_t> m_closed;
+  uint32_t m_epoch;
+  uint32_t m_closed_epoch;
+};
+
+#endif
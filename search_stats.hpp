@@ -0,0 +1,220 @@
+#ifndef SEARCH_STATS_HPP
+#define SEARCH_STATS_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Per-query search statistics.
+//
+// A search_stats object collects what a run did: for every query the
+// expansions, edge relaxations, heap pushes and decrease-keys, the largest
+// open list and an estimate of the scratch memory, plus wall-clock phases
+// (map build, search, path extraction, render, ...).  It can be written as
+// JSON or in the Chrome trace-event format (chrome://tracing, Perfetto).
+//
+// Collection is compiled in with -DSEARCH_STATS (the SEARCH_STATS CMake
+// option).  Without it the same interface is made of empty inline functions,
+// kSearchStatsEnabled is false and searches skip their statistics visitors,
+// so the calls cost nothing.
+
+#ifdef SEARCH_STATS
+const bool kSearchStatsEnabled = true;
+#else
+const bool kSearchStatsEnabled = false;
+#endif
+
+struct query_stats {
+  std::string name;
+  uint64_t expansions = 0;
+  uint64_t relaxations = 0;
+  uint64_t pushes = 0;
+  uint64_t decrease_keys = 0;
+  uint64_t max_open = 0;
+  std::size_t scratch_bytes = 0;
+};
+
+struct phase_stats {
+  std::string name;
+  // Query the phase belongs to, -1 for phases outside any query
+  long query;
+  // Microseconds since the search_stats object was created
+  double start_us;
+  double duration_us;
+};
+
+#ifdef SEARCH_STATS
+
+class search_stats {
+public:
+  search_stats():m_epoch(std::chrono::steady_clock::now()),m_open(0) {};
+
+  // Start counting a new query; later counts go to it.
+  void begin_query(const std::string& name) {
+    query_stats q;
+    q.name = name;
+    m_queries.push_back(q);
+    m_open = 0;
+  }
+
+  void expanded() {++current().expansions; --m_open;}
+  void relaxed() {++current().relaxations;}
+  void pushed() {
+    query_stats& q = current();
+    ++q.pushes;
+    q.max_open = std::max<uint64_t>(q.max_open, ++m_open);
+  }
+  // Decrease-keys are the relaxations that did not push.
+  void end_query(std::size_t scratchBytes) {
+    query_stats& q = current();
+    q.decrease_keys = q.pushes > 0 && q.relaxations + 1 > q.pushes ? q.relaxations + 1 - q.pushes : 0;
+    q.scratch_bytes = scratchBytes;
+  }
+
+  double now_us() const {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - m_epoch).count();
+  }
+  void add_phase(const std::string& name, bool inQuery, double start_us, double duration_us) {
+    phase_stats p = {name, inQuery && !m_queries.empty() ? long(m_queries.size()) - 1 : -1,
+                     start_us, duration_us};
+    m_phases.push_back(p);
+  }
+
+  const std::vector<query_stats>& queries() const {return m_queries;}
+  const std::vector<phase_stats>& phases() const {return m_phases;}
+  std::size_t peak_scratch_bytes() const {
+    std::size_t peak = 0;
+    for (const query_stats& q : m_queries)
+      peak = std::max(peak, q.scratch_bytes);
+    return peak;
+  }
+
+  void write_json(std::ostream& out) const {
+    fixed_point format(out);
+    out << "{\n  \"queries\": [";
+    for (std::size_t i = 0; i < m_queries.size(); ++i) {
+      const query_stats& q = m_queries[i];
+      out << (i ? ",\n" : "\n") << "    {\"name\": \"" << q.name << "\", \"expansions\": " << q.expansions
+          << ", \"relaxations\": " << q.relaxations << ", \"pushes\": " << q.pushes
+          << ", \"decrease_keys\": " << q.decrease_keys << ", \"max_open\": " << q.max_open
+          << ", \"scratch_bytes\": " << q.scratch_bytes << "}";
+    }
+    out << "\n  ],\n  \"phases\": [";
+    for (std::size_t i = 0; i < m_phases.size(); ++i) {
+      const phase_stats& p = m_phases[i];
+      out << (i ? ",\n" : "\n") << "    {\"name\": \"" << p.name << "\", \"query\": " << p.query
+          << ", \"start_us\": " << p.start_us << ", \"duration_us\": " << p.duration_us << "}";
+    }
+    out << "\n  ],\n  \"peak_scratch_bytes\": " << peak_scratch_bytes() << "\n}\n";
+  }
+
+  // Phases become complete ("X") events, one track per query; each query's
+  // counters are attached to its search phase and also emitted as a counter
+  // ("C") event so they plot over time.
+  void write_chrome_trace(std::ostream& out) const {
+    fixed_point format(out);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    bool first = true;
+    for (const phase_stats& p : m_phases) {
+      out << (first ? "\n" : ",\n") << "  {\"name\": \"" << p.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+          << p.query + 2 << ", \"ts\": " << p.start_us << ", \"dur\": " << p.duration_us;
+      if (p.query >= 0) {
+        const query_stats& q = m_queries[std::size_t(p.query)];
+        out << ", \"args\": {\"query\": \"" << q.name << "\"";
+        if (p.name == "search")
+          out << ", \"expansions\": " << q.expansions << ", \"relaxations\": " << q.relaxations
+              << ", \"pushes\": " << q.pushes << ", \"decrease_keys\": " << q.decrease_keys
+              << ", \"max_open\": " << q.max_open << ", \"scratch_bytes\": " << q.scratch_bytes;
+        out << "}";
+      }
+      out << "}";
+      if (p.query >= 0 && p.name == "search") {
+        const query_stats& q = m_queries[std::size_t(p.query)];
+        out << ",\n  {\"name\": \"open list\", \"ph\": \"C\", \"pid\": 1, \"ts\": " << p.start_us + p.duration_us
+            << ", \"args\": {\"max_open\": " << q.max_open << ", \"expansions\": " << q.expansions << "}}";
+      }
+      first = false;
+    }
+    out << "\n]}\n";
+  }
+
+private:
+  // Microsecond times with one decimal for as long as it lives.
+  struct fixed_point {
+    explicit fixed_point(std::ostream& out):m_out(out), m_flags(out.flags()), m_precision(out.precision()) {
+      out << std::fixed << std::setprecision(1);
+    }
+    ~fixed_point() {
+      m_out.flags(m_flags);
+      m_out.precision(m_precision);
+    }
+    std::ostream& m_out;
+    std::ios::fmtflags m_flags;
+    std::streamsize m_precision;
+  };
+
+  query_stats& current() {
+    if (m_queries.empty())
+      begin_query("query");
+    return m_queries.back();
+  }
+
+  std::chrono::steady_clock::time_point m_epoch;
+  std::vector<query_stats> m_queries;
+  std::vector<phase_stats> m_phases;
+  uint64_t m_open;
+};
+
+// Times the enclosing scope as a phase of stats, if stats is given.
+class stats_phase {
+public:
+  stats_phase(search_stats* stats, const char* name, bool inQuery = false):
+    m_stats(stats), m_name(name), m_inQuery(inQuery), m_start(stats ? stats->now_us() : 0) {};
+  ~stats_phase() {stop();}
+
+  // End the phase before the scope does.
+  void stop() {
+    if (m_stats)
+      m_stats->add_phase(m_name, m_inQuery, m_start, m_stats->now_us() - m_start);
+    m_stats = nullptr;
+  }
+
+private:
+  search_stats* m_stats;
+  const char* m_name;
+  bool m_inQuery;
+  double m_start;
+};
+
+#else
+
+class search_stats {
+public:
+  void begin_query(const std::string&) {}
+  void expanded() {}
+  void relaxed() {}
+  void pushed() {}
+  void end_query(std::size_t) {}
+  double now_us() const {return 0;}
+  void add_phase(const std::string&, bool, double, double) {}
+  std::vector<query_stats> queries() const {return std::vector<query_stats>();}
+  std::vector<phase_stats> phases() const {return std::vector<phase_stats>();}
+  std::size_t peak_scratch_bytes() const {return 0;}
+  void write_json(std::ostream& out) const {out << "{}\n";}
+  void write_chrome_trace(std::ostream& out) const {out << "{\"traceEvents\": []}\n";}
+};
+
+class stats_phase {
+public:
+  stats_phase(search_stats*, const char*, bool = false) {}
+  void stop() {}
+};
+
+#endif
+
+#endif
@@ -0,0 +1,226 @@
+#ifndef SSSP_HPP
+#define SSSP_HPP
+
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "parallel.hpp"
+#include "search_scratch.hpp"
+#include "utility.hpp"
+
+// Complete single-source shortest-path trees over the island.
+
+// Distances and predecessors for every cell.  Unreachable cells have
+// infinite distance; the source is its own predecessor.
+struct shortest_path_tree {
+  cell_vector<distance> dist;
+  cell_vector<uint32_t> pred;
+};
+
+// Fill tree.pred from tree.dist: every reached cell takes the first
+// neighbour (in for_each_neighbour order) that realises its distance.  Being
+// a pure function of the distances this gives the same tree however the
+// distances were computed.
+inline void assign_predecessors(const maze& m, std::size_t source, shortest_path_tree& tree,
+                                unsigned threads = default_threads()) {
+  tree.pred.assign(m.num_cells(), 0);
+  parallel_for(0, m.num_cells(), threads, [&](std::size_t first, std::size_t last, unsigned) {
+    for (std::size_t v = first; v < last; ++v) {
+      tree.pred[v] = uint32_t(v);
+      if (v == source || !(tree.dist[v] < std::numeric_limits<distance>::infinity()))
+        continue;
+      bool found = false;
+      m.for_each_neighbour(v, [&](std::size_t u) {
+        if (!found && tree.dist[u] + m.stepCost(u, v) == tree.dist[v]) {
+          tree.pred[v] = uint32_t(u);
+          found = true;
+        }
+      });
+    }
+  });
+}
+
+// Serial Dijkstra over the flat grid.  The reference for delta_stepping.
+inline void dijkstra(const maze& m, vertex_descriptor source, shortest_path_tree& tree) {
+  const std::size_t src = m.index(source);
+  tree.dist.assign(m.num_cells(), std::numeric_limits<distance>::infinity());
+  if (!m.passable(src)) {
+    assign_predecessors(m, src, tree, 1);
+    return;
+  }
+  search_scratch s;
+  s.reset(m.num_cells());
+  open_list open;
+  s.set(src, 0, src);
+  open.push(open_entry(0, uint32_t(src)));
+  while (!open.empty()) {
+    open_entry top = open.top();
+    open.pop();
+    std::size_t u = top.second;
+    if (s.closed(u))
+      continue;
+    s.close(u);
+    tree.dist[u] = top.first;
+    m.for_each_edge(u, [&](std::size_t v, double w) {
+      double d = top.first + w;
+      if (d < s.dist(v)) {
+        s.set(v, d, u);
+        open.push(open_entry(d, uint32_t(v)));
+      }
+    });
+  }
+  assign_predecessors(m, src, tree, 1);
+}
+
+// Parallel delta-stepping (Meyer & Sanders).
+//
+// Tentative distances live in a shared array updated with compare-and-swap.
+// Every thread keeps its own cyclic array of buckets of width delta and files
+// each cell it improves into its own bucket, so no bucket is ever shared.  The
+// current bucket is drained in phases: each thread publishes its part of the
+// bucket as a frontier, and threads claim chunks of frontiers through atomic
+// cursors, starting with their own and then stealing from the others.  Light
+// edges (cost <= delta) are relaxed until the bucket stays empty, after which
+// the heavy edges of every cell settled in the bucket are relaxed once.
+//
+// The distances are the least fixpoint of d(v) = min(d(u) + w(u, v)), summed
+// in path order exactly as Dijkstra does, so they match dijkstra() bit for bit.
+inline void delta_stepping(const maze& m, vertex_descriptor source, shortest_path_tree& tree,
+                           double delta = 2.0, unsigned threads = default_threads()) {
+  const std::size_t cells = m.num_cells();
+  const std::size_t src = m.index(source);
+  const distance infinity = std::numeric_limits<distance>::infinity();
+  tree.dist.assign(cells, infinity);
+  if (!m.passable(src)) {
+    assign_predecessors(m, src, tree, threads);
+    return;
+  }
+
+  std::unique_ptr<std::atomic<distance>[]> dist(new std::atomic<distance>[cells]);
+  parallel_for(0, cells, threads, [&](std::size_t first, std::size_t last, unsigned) {
+    for (std::size_t i = first; i < last; ++i)
+      dist[i].store(infinity, std::memory_order_relaxed);
+  });
+  dist[src].store(0, std::memory_order_relaxed);
+
+  // Every edge cost is below the steepest allowed climb, so a relaxation
+  // never lands more than this many buckets ahead of the current one.
+  const double maxCost = slopeTime(1, 255);
+  const std::size_t ring = std::size_t(std::ceil(maxCost/delta)) + 2;
+  const std::size_t chunk = 256;
+
+  struct worker_state {
+    std::vector<std::vector<uint32_t> > buckets;
+    std::vector<uint32_t> frontier;
+    std::vector<uint32_t> settled;
+    std::atomic<std::size_t> cursor;
+    std::size_t next;
+  };
+  std::vector<worker_state> workers(threads);
+  for (worker_state& w : workers)
+    w.buckets.resize(ring);
+  workers[0].buckets[0].push_back(uint32_t(src));
+
+  thread_barrier barrier(threads);
+  std::size_t current = 0;
+  std::atomic<bool> pending(false);
+
+  parallel_invoke(threads, [&](unsigned t) {
+    worker_state& self = workers[t];
+
+    auto relax = [&](std::size_t v, distance d) {
+      distance old = dist[v].load(std::memory_order_relaxed);
+      while (d < old) {
+        if (dist[v].compare_exchange_weak(old, d, std::memory_order_relaxed)) {
+          self.buckets[std::size_t(d/delta) % ring].push_back(uint32_t(v));
+          return;
+        }
+      }
+    };
+    // Claim chunks of every worker's list, own list first.
+    auto drain = [&](std::vector<uint32_t> worker_state::*list, auto visit) {
+      for (unsigned k = 0; k < threads; ++k) {
+        worker_state& victim = workers[(t + k) % threads];
+        const std::vector<uint32_t>& items = victim.*list;
+        std::size_t begin;
+        while ((begin = victim.cursor.fetch_add(chunk, std::memory_order_relaxed)) < items.size()) {
+          std::size_t end = std::min(items.size(), begin + chunk);
+          for (std::size_t i = begin; i < end; ++i)
+            visit(items[i]);
+        }
+      }
+    };
+
+    while (true) {
+      // Agree on the next non-empty bucket.
+      self.next = std::numeric_limits<std::size_t>::max();
+      for (std::size_t k = 0; k < ring; ++k)
+        if (!self.buckets[(current + k) % ring].empty()) {
+          self.next = current + k;
+          break;
+        }
+      barrier.wait();
+      std::size_t next = std::numeric_limits<std::size_t>::max();
+      for (const worker_state& w : workers)
+        next = std::min(next, w.next);
+      if (next == std::numeric_limits<std::size_t>::max())
+        break;
+      barrier.wait();
+      if (t == 0)
+        current = next;
+      self.settled.clear();
+      barrier.wait();
+
+      // Light phases until the bucket stays empty.
+      const double lo = current*delta, hi = (current + 1)*delta;
+      while (true) {
+        self.frontier.clear();
+        self.frontier.swap(self.buckets[current % ring]);
+        self.cursor.store(0, std::memory_order_relaxed);
+        barrier.wait();
+        drain(&worker_state::frontier, [&](std::size_t u) {
+          distance du = dist[u].load(std::memory_order_relaxed);
+          if (du < lo || du >= hi)
+            return;
+          self.settled.push_back(uint32_t(u));
+          m.for_each_edge(u, [&](std::size_t v, double w) {
+            if (w <= delta)
+              relax(v, du + w);
+          });
+        });
+        if (t == 0)
+          pending.store(false);
+        barrier.wait();
+        if (!self.buckets[current % ring].empty())
+          pending.store(true);
+        barrier.wait();
+        if (!pending.load())
+          break;
+        barrier.wait();
+      }
+
+      // Heavy edges of everything settled in this bucket.
+      self.cursor.store(0, std::memory_order_relaxed);
+      barrier.wait();
+      drain(&worker_state::settled, [&](std::size_t u) {
+        distance du = dist[u].load(std::memory_order_relaxed);
+        m.for_each_edge(u, [&](std::size_t v, double w) {
+          if (w > delta)
+            relax(v, du + w);
+        });
+      });
+      barrier.wait();
+    }
+  });
+
+  parallel_for(0, cells, threads, [&](std::size_t first, std::size_t last, unsigned) {
+    for (std::size_t i = first; i < last; ++i)
+      tree.dist[i] = dist[i].load(std::memory_order_relaxed);
+  });
+  assign_predecessors(m, src, tree, threads);
+}
+
+#endif
@@ -0,0 +1,317 @@
+#ifndef TILED_MAP_HPP
+#define TILED_MAP_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <list>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define TILED_MAP_HAS_MMAP
+#endif
+
+#include "utility.hpp"
+
+// Tiled storage for maps too large to hold as one raster.
+//
+// A tiled map file holds a single terrain plane: the elevation of every cell,
+// with 0 wherever the rover cannot drive (water, marsh, or zero elevation, the
+// same rule make_maze applies).  The plane is cut into square tiles stored one
+// after the other in row-major tile order, after a header padded to 4096 bytes.
+// A tile starts on a page boundary only when tile_size^2 is a multiple of the
+// page size, so each tile is mapped from the page holding its first byte.
+
+struct tiled_map_header {
+  char magic[4];          // "FPTM"
+  uint32_t version;
+  uint64_t width;
+  uint64_t height;
+  uint64_t tile_size;
+};
+
+const std::size_t kTiledMapHeaderBytes = 4096;
+
+// Convert row-major elevation and overrides rasters into a tiled map file.
+// Reads one band of tile_size rows at a time, so memory use is
+// 2 * width * tile_size bytes whatever the map size.
+inline bool write_tiled_map(const char* elevationPath, const char* overridesPath,
+                            std::size_t width, std::size_t height, const char* outPath,
+                            std::size_t tileSize = 256) {
+  std::ifstream elevationIn(elevationPath, std::ifstream::binary);
+  std::ifstream overridesIn(overridesPath, std::ifstream::binary);
+  std::ofstream out(outPath, std::ofstream::binary);
+  if (!elevationIn.good() || !overridesIn.good() || !out.good())
+    return false;
+
+  tiled_map_header header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, "FPTM", 4);
+  header.version = 1;
+  header.width = width;
+  header.height = height;
+  header.tile_size = tileSize;
+  std::vector<char> page(kTiledMapHeaderBytes, 0);
+  std::memcpy(&page[0], &header, sizeof(header));
+  out.write(&page[0], page.size());
+
+  const std::size_t tilesX = (width + tileSize - 1)/tileSize;
+  const std::size_t tilesY = (height + tileSize - 1)/tileSize;
+  std::vector<uint8_t> elevation(width*tileSize), overrides(width*tileSize);
+  std::vector<uint8_t> tile(tileSize*tileSize);
+  for (std::size_t ty = 0; ty < tilesY; ++ty) {
+    std::size_t rows = std::min(tileSize, height - ty*tileSize);
+    elevationIn.read((char*)&elevation[0], rows*width);
+    overridesIn.read((char*)&overrides[0], rows*width);
+    if (!elevationIn.good() || !overridesIn.good())
+      return false;
+    for (std::size_t tx = 0; tx < tilesX; ++tx) {
+      std::fill(tile.begin(), tile.end(), 0);
+      std::size_t cols = std::min(tileSize, width - tx*tileSize);
+      for (std::size_t y = 0; y < rows; ++y)
+        for (std::size_t x = 0; x < cols; ++x) {
+          std::size_t i = y*width + tx*tileSize + x;
+          bool barrier = (overrides[i] & (OF_WATER_BASIN | OF_RIVER_MARSH)) || elevation[i] == 0;
+          tile[y*tileSize + x] = barrier ? 0 : elevation[i];
+        }
+      out.write((const char*)&tile[0], tile.size());
+    }
+  }
+  return out.good();
+}
+
+// Read access to a tiled map file through a bounded cache of mapped tiles.
+//
+// Tiles are mapped on first access and unmapped in least recently used order
+// once more than capacity tiles are resident, so memory use is bounded by
+// capacity * tile_size^2 however large the map is.  Not thread safe.
+class tiled_map {
+public:
+  struct cache_stats {
+    std::size_t hits;
+    std::size_t misses;
+    std::size_t evictions;
+  };
+
+  tiled_map(std::size_t capacity = 256):m_fd(-1),m_capacity(std::max<std::size_t>(1, capacity)),
+    m_lastKey(std::numeric_limits<std::size_t>::max()),m_lastTile(nullptr),m_stats() {};
+  ~tiled_map() {close();}
+  tiled_map(const tiled_map&) = delete;
+  tiled_map& operator=(const tiled_map&) = delete;
+
+  bool open(const char* path);
+  void close();
+
+  std::size_t width() const {return std::size_t(m_header.width);}
+  std::size_t height() const {return std::size_t(m_header.height);}
+  std::size_t tile_size() const {return std::size_t(m_header.tile_size);}
+  const cache_stats& stats() const {return m_stats;}
+  std::size_t resident_tiles() const {return m_tiles.size();}
+
+  // Terrain value of a cell: its elevation, or 0 for a barrier.
+  uint8_t at(std::size_t x, std::size_t y) {
+    const std::size_t T = tile_size();
+    std::size_t key = (y/T)*m_tilesX + x/T;
+    const uint8_t* tile = key == m_lastKey ? m_lastTile : fetch(key);
+    return tile[(y % T)*T + x % T];
+  }
+
+  bool passable(std::size_t x, std::size_t y) {return at(x, y) != 0;}
+
+private:
+  struct resident_tile {
+    // Start and length of the mapping, and the tile inside it
+    uint8_t* base;
+    std::size_t length;
+    uint8_t* data;
+    std::list<std::size_t>::iterator lru;
+  };
+
+  const uint8_t* fetch(std::size_t key);
+  void unmap(const resident_tile& tile);
+
+  std::string m_path;
+  int m_fd;
+  tiled_map_header m_header;
+  std::size_t m_tilesX;
+  std::size_t m_capacity;
+  std::unordered_map<std::size_t, resident_tile> m_tiles;
+  // Most recently used tile at the front
+  std::list<std::size_t> m_lru;
+  std::size_t m_lastKey;
+  const uint8_t* m_lastTile;
+  cache_stats m_stats;
+};
+
+
+inline bool tiled_map::open(const char* path) {
+  close();
+  m_path = path;
+  std::ifstream in(path, std::ifstream::binary);
+  in.read((char*)&m_header, sizeof(m_header));
+  if (!in.good() || std::memcmp(m_header.magic, "FPTM", 4) != 0 || m_header.version != 1)
+    return false;
+  m_tilesX = std::size_t((m_header.width + m_header.tile_size - 1)/m_header.tile_size);
+#ifdef TILED_MAP_HAS_MMAP
+  m_fd = ::open(path, O_RDONLY);
+  if (m_fd < 0)
+    return false;
+#endif
+  return true;
+}
+
+inline void tiled_map::close() {
+  for (auto& entry : m_tiles)
+    unmap(entry.second);
+  m_tiles.clear();
+  m_lru.clear();
+  m_lastKey = std::numeric_limits<std::size_t>::max();
+  m_lastTile = nullptr;
+#ifdef TILED_MAP_HAS_MMAP
+  if (m_fd >= 0)
+    ::close(m_fd);
+#endif
+  m_fd = -1;
+}
+
+inline void tiled_map::unmap(const resident_tile& tile) {
+#ifdef TILED_MAP_HAS_MMAP
+  munmap(tile.base, tile.length);
+#else
+  delete[] tile.base;
+#endif
+}
+
+inline const uint8_t* tiled_map::fetch(std::size_t key) {
+  auto found = m_tiles.find(key);
+  if (found != m_tiles.end()) {
+    ++m_stats.hits;
+    m_lru.splice(m_lru.begin(), m_lru, found->second.lru);
+  } else {
+    ++m_stats.misses;
+    if (m_tiles.size() >= m_capacity) {
+      std::size_t victim = m_lru.back();
+      m_lru.pop_back();
+      unmap(m_tiles[victim]);
+      m_tiles.erase(victim);
+      ++m_stats.evictions;
+    }
+    const std::size_t bytes = tile_size()*tile_size();
+    const uint64_t offset = kTiledMapHeaderBytes + uint64_t(key)*bytes;
+#ifdef TILED_MAP_HAS_MMAP
+    // mmap offsets must be page aligned
+    const uint64_t page = uint64_t(sysconf(_SC_PAGESIZE));
+    const std::size_t skip = std::size_t(offset % page);
+    void* base = mmap(nullptr, bytes + skip, PROT_READ, MAP_PRIVATE, m_fd, off_t(offset - skip));
+    if (base == MAP_FAILED)
+      throw std::exception();
+    resident_tile tile = {(uint8_t*)base, bytes + skip, (uint8_t*)base + skip, m_lru.end()};
+#else
+    uint8_t* data = new uint8_t[bytes];
+    std::ifstream in(m_path.c_str(), std::ifstream::binary);
+    in.seekg(offset);
+    in.read((char*)data, bytes);
+    resident_tile tile = {data, bytes, data, m_lru.end()};
+#endif
+    m_lru.push_front(key);
+    tile.lru = m_lru.begin();
+    found = m_tiles.insert(std::make_pair(key, tile)).first;
+  }
+  m_lastKey = key;
+  m_lastTile = found->second.data;
+  return m_lastTile;
+}
+
+
+// A* over a tiled map.
+//
+// Uses the same 4-connected moves, slope model and Manhattan heuristic as
+// maze::solve, but keeps its state in hash maps keyed by cell, so memory grows
+// with the explored region rather than the map, and only the tiles along the
+// frontier are ever paged in.  Returns true and fills path (source to goal)
+// and length if the goal is reachable.
+inline bool solve_tiled(tiled_map& map, vertex_descriptor source, vertex_descriptor goal,
+                        std::vector<vertex_descriptor>& path, distance& length) {
+  const uint64_t w = map.width(), h = map.height();
+  auto id = [&](uint64_t x, uint64_t y) {return y*w + x;};
+  const uint64_t src = id(source[0], source[1]), dst = id(goal[0], goal[1]);
+  if (!map.passable(source[0], source[1]) || !map.passable(goal[0], goal[1]))
+    return false;
+
+  struct node {
+    distance g;
+    uint64_t pred;
+    bool closed;
+  };
+  std::unordered_map<uint64_t, node> nodes;
+  typedef std::pair<double, uint64_t> entry;
+  std::priority_queue<entry, std::vector<entry>, std::greater<entry> > open;
+  auto heuristic = [&](uint64_t x, uint64_t y) {
+    return double(std::abs(long(x) - long(goal[0])) + std::abs(long(y) - long(goal[1])));
+  };
+
+  node start = {0, src, false};
+  nodes[src] = start;
+  open.push(entry(heuristic(source[0], source[1]), src));
+  while (!open.empty()) {
+    uint64_t u = open.top().second;
+    open.pop();
+    node& nu = nodes[u];
+    if (nu.closed)
+      continue;
+    nu.closed = true;
+    if (u == dst)
+      break;
+    const distance gu = nu.g;
+    const uint64_t ux = u % w, uy = u / w;
+    const int eu = map.at(ux, uy);
+    const uint64_t nx[4] = {ux - 1, ux + 1, ux, ux};
+    const uint64_t ny[4] = {uy, uy, uy - 1, uy + 1};
+    for (int k = 0; k < 4; ++k) {
+      // Unsigned wrap-around puts off-map neighbours past the edge
+      if (nx[k] >= w || ny[k] >= h)
+        continue;
+      const int ev = map.at(nx[k], ny[k]);
+      if (ev == 0)
+        continue;
+      const uint64_t v = id(nx[k], ny[k]);
+      const distance gv = gu + stepTime(ev - eu);
+      auto found = nodes.find(v);
+      if (found == nodes.end()) {
+        node n = {gv, u, false};
+        nodes.insert(std::make_pair(v, n));
+      } else if (!found->second.closed && gv < found->second.g) {
+        found->second.g = gv;
+        found->second.pred = u;
+      } else {
+        continue;
+      }
+      open.push(entry(gv + heuristic(nx[k], ny[k]), v));
+    }
+  }
+
+  auto reached = nodes.find(dst);
+  if (reached == nodes.end() || !reached->second.closed)
+    return false;
+  path.clear();
+  for (uint64_t u = dst; ; u = nodes[u].pred) {
+    vertex_descriptor cell = {{std::size_t(u % w), std::size_t(u / w)}};
+    path.push_back(cell);
+    if (u == src)
+      break;
+  }
+  std::reverse(path.begin(), path.end());
+  length = reached->second.g;
+  return true;
+}
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef TRAVEL_MATRIX_HPP
+#define TRAVEL_MATRIX_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "parallel.hpp"
+#include "search_scratch.hpp"
+#include "utility.hpp"
+
+// Dense sources x targets matrix of travel times, row-major.  Unreachable
+// pairs hold infinity.
+struct travel_time_matrix {
+  std::size_t rows;
+  std::size_t cols;
+  std::vector<distance> times;
+
+  distance at(std::size_t source, std::size_t target) const {return times[source*cols + target];}
+};
+
+// Travel times from every source to every target.
+//
+// Runs one Dijkstra per source instead of one search per pair.  Each search
+// stops as soon as every target on the source's island has been settled;
+// targets on other islands stay infinite without being searched for.  Sources are
+// handed out to the threads through a shared counter, and every thread
+// reuses its own search_scratch, so nothing is cleared between searches.
+inline travel_time_matrix travel_times(const maze& m,
+                                       const std::vector<vertex_descriptor>& sources,
+                                       const std::vector<vertex_descriptor>& targets,
+                                       unsigned threads = default_threads()) {
+  travel_time_matrix result;
+  result.rows = sources.size();
+  result.cols = targets.size();
+  result.times.assign(result.rows*result.cols, std::numeric_limits<distance>::infinity());
+
+  // Target cells sorted by index, each with the column it fills.  Duplicate
+  // targets share a cell and are only counted once, per component.
+  std::vector<std::pair<uint32_t, uint32_t> > columns;
+  std::vector<uint8_t> isTarget(m.num_cells(), 0);
+  std::vector<std::size_t> distinct(m.num_components() + 1, 0);
+  for (std::size_t c = 0; c < targets.size(); ++c) {
+    std::size_t i = m.index(targets[c]);
+    if (!m.passable(i))
+      continue;
+    columns.push_back(std::make_pair(uint32_t(i), uint32_t(c)));
+    if (!isTarget[i]) {
+      isTarget[i] = 1;
+      ++distinct[m.component(i)];
+    }
+  }
+  std::sort(columns.begin(), columns.end());
+
+  std::atomic<std::size_t> nextSource(0);
+  threads = unsigned(std::max<std::size_t>(1, std::min<std::size_t>(threads, sources.size())));
+  parallel_invoke(threads, [&](unsigned) {
+    search_scratch s;
+    open_list open;
+    std::size_t r;
+    while ((r = nextSource.fetch_add(1)) < sources.size()) {
+      const std::size_t src = m.index(sources[r]);
+      if (!m.passable(src) || distinct[m.component(src)] == 0)
+        continue;
+      s.reset(m.num_cells());
+      open = open_list();
+      s.set(src, 0, src);
+      open.push(open_entry(0, uint32_t(src)));
+      std::size_t remaining = distinct[m.component(src)];
+      distance* row = &result.times[r*result.cols];
+
+      while (!open.empty() && remaining > 0) {
+        open_entry top = open.top();
+        open.pop();
+        std::size_t u = top.second;
+        if (s.closed(u))
+          continue;
+        s.close(u);
+        if (isTarget[u]) {
+          auto hits = std::equal_range(columns.begin(), columns.end(),
+                                       std::make_pair(uint32_t(u), uint32_t(0)),
+                                       [](const std::pair<uint32_t, uint32_t>& a,
+                                          const std::pair<uint32_t, uint32_t>& b) {
+                                         return a.first < b.first;
+                                       });
+          for (auto hit = hits.first; hit != hits.second; ++hit)
+            row[hit->second] = top.first;
+          --remaining;
+        }
+        m.for_each_edge(u, [&](std::size_t v, double w) {
+          double d = top.first + w;
+          if (d < s.dist(v)) {
+            s.set(v, d, u);
+            open.push(open_entry(d, uint32_t(v)));
+          }
+        });
+      }
+    }
+  });
+  return result;
+}
+
+#endif
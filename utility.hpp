@@ -13,6 +13,10 @@
 #include <ctime>
 #include <iostream>
 #include "visualizer.h"
+#include "cell_memory.hpp"
+#include "edge_costs.hpp"
+#include "map_build.hpp"
+#include "search_stats.hpp"
 
 
 #include <type_traits>
@@ -20,9 +24,45 @@
 #include <memory>
 #include <string>
 #include <cstdlib>
+#include <cmath>
+#include <limits>
 
 const int cwConstant = 5; //(mass * gravitational constant * cell length)/Power
 
+// Time taken by the rover to cover a horizontal run (given squared, in cells)
+// while climbing or descending delta elevation steps. This is the model used by
+// maze::timeWeight, generalised so that longer straight segments and local
+// gradients can use it.
+inline double slopeTime(double run2, double delta)
+{
+  return sqrt(run2 + 0.003937*pow(delta,2)) + cwConstant*0.0627455*std::abs(delta);
+}
+
+// slopeTime of one grid step, straight (run2 == 1) or diagonal (run2 == 2),
+// for every absolute elevation difference, rounded to float.  The edge cost
+// planes are filled from these, and searches that work without the planes
+// use them too so that every search agrees on path lengths.
+inline const float* stepTimeTable(int run2)
+{
+  struct tables {
+    tables() {
+      for (int d = 0; d < 256; ++d) {
+        times[0][d] = float(slopeTime(1, d));
+        times[1][d] = float(slopeTime(2, d));
+      }
+    }
+    float times[2][256];
+  };
+  static const tables t;
+  return t.times[run2 - 1];
+}
+
+// Travel time between two 4-adjacent cells delta elevation steps apart.
+inline double stepTime(int delta)
+{
+  return stepTimeTable(1)[std::abs(delta)];
+}
+
 enum OverrideFlags
 {
     OF_RIVER_MARSH = 0x10,
@@ -71,8 +111,61 @@ struct vertex_hash:std::unary_function<vertex_descriptor, std::size_t> {
 };
 
 typedef boost::unordered_set<vertex_descriptor, vertex_hash> vertex_set;
-typedef boost::vertex_subset_complement_filter<grid, vertex_set>::type
-        filtered_grid;
+
+// Vertex filter keeping the cells whose bit is set in a passable bitmap.
+struct passable_filter {
+  passable_filter():m_bits(nullptr),m_width(0) {};
+  passable_filter(const cell_vector<uint64_t>* bits, std::size_t width):m_bits(bits),m_width(width) {};
+
+  bool operator()(vertex_descriptor u) const {
+    std::size_t i = u[0] + u[1]*m_width;
+    return (((*m_bits)[i >> 6] >> (i & 63)) & 1) != 0;
+  }
+
+private:
+  const cell_vector<uint64_t>* m_bits;
+  std::size_t m_width;
+};
+
+typedef boost::filtered_graph<grid, boost::keep_all, passable_filter> filtered_grid;
+
+// Per-cell record of what a search did, kept in compact planes so that it
+// can be rendered as a heatmap when tuning heuristics.
+struct search_trace {
+  enum cell_state {UNSEEN = 0, OPEN = 1, CLOSED = 2};
+
+  void reset(std::size_t cells) {
+    order.assign(cells, 0);
+    g.assign(cells, std::numeric_limits<float>::infinity());
+    state.assign(cells, UNSEEN);
+    expansions = 0;
+  }
+
+  // Expansion order as a plane of times, infinite where never expanded.
+  std::vector<float> expansion_plane() const {
+    std::vector<float> plane(order.size());
+    for (std::size_t i = 0; i < order.size(); ++i)
+      plane[i] = order[i] ? float(order[i]) : std::numeric_limits<float>::infinity();
+    return plane;
+  }
+
+  // Open/closed state as a plane, infinite where never seen.
+  std::vector<float> state_plane() const {
+    std::vector<float> plane(state.size());
+    for (std::size_t i = 0; i < state.size(); ++i)
+      plane[i] = state[i] ? float(state[i]) : std::numeric_limits<float>::infinity();
+    return plane;
+  }
+
+  // 1-based expansion order, 0 if the cell was never expanded
+  std::vector<uint32_t> order;
+  // Last g-value the search assigned, infinite if never reached
+  std::vector<float> g;
+  // One of cell_state
+  std::vector<uint8_t> state;
+  // Number of expanded cells
+  uint32_t expansions;
+};
 
 //typedef boost::property_map<grid, boost::edge_weight_t>::type WeightMap;
 // A searchable maze
@@ -92,19 +185,69 @@ public:
   friend std::ostream& operator<<(std::ostream&, const maze&);
   friend maze random_maze(std::size_t, std::size_t);
 
-  maze():m_grid(create_grid(0, 0)),m_barrier_grid(create_barrier_grid()) {};
+  maze():m_grid(create_grid(0, 0)),m_barrier_count(0),m_component_count(0),
+         m_barrier_grid(create_barrier_grid()) {};
 
   maze(std::size_t x, std::size_t y, const std::vector<uint8_t>& elevation):m_grid(create_grid(x, y)),
-       m_barrier_grid(create_barrier_grid()),m_elev(elevation){};
+       m_elev(elevation.begin(), elevation.end()),m_barrier_count(0),m_component_count(0),
+       m_barrier_grid(create_barrier_grid()) {};
 
   // The length of the maze along the specified dimension.
   vertices_size_type length(std::size_t d) const {return m_grid.length(d);}
 
-  bool has_barrier(vertex_descriptor u) const {
-    return m_barriers.find(u) != m_barriers.end();
+  bool has_barrier(vertex_descriptor u) const {return !passable(index(u));}
+
+  // Flat (row-major) cell index used by the array based searches.
+  std::size_t index(vertex_descriptor u) const {return u[0] + u[1]*length(0);}
+  vertex_descriptor cell(std::size_t i) const {return vertex(i, m_grid);}
+  std::size_t num_cells() const {return m_elev.size();}
+  bool passable(std::size_t i) const {return ((m_passable[i >> 6] >> (i & 63)) & 1) != 0;}
+  std::size_t num_barriers() const {return m_barrier_count;}
+
+  // Connected region of cell i, numbered from 1; 0 for barriers.
+  uint32_t component(std::size_t i) const {return m_component[i];}
+  std::size_t num_components() const {return m_component_count;}
+  // Whether a 4-connected path joins cells a and b.
+  bool connected(std::size_t a, std::size_t b) const {
+    return m_component[a] != 0 && m_component[a] == m_component[b];
   }
 
-  bool solve(vertex_descriptor source, vertex_descriptor goal);
+  // Travel time between two 4-adjacent cells given by flat index.
+  double stepCost(std::size_t source, std::size_t target) const {
+    if (target == source + 1) return m_costs.east[source];
+    if (source == target + 1) return m_costs.east[target];
+    if (target > source) return m_costs.south[source];
+    return m_costs.south[target];
+  }
+
+  // Call f(n) for every traversable 4-neighbour n of cell i.
+  template <typename F>
+  void for_each_neighbour(std::size_t i, F f) const {
+    const std::size_t w = length(0);
+    const std::size_t x = i % w;
+    if (x > 0 && passable(i - 1)) f(i - 1);
+    if (x + 1 < w && passable(i + 1)) f(i + 1);
+    if (i >= w && passable(i - w)) f(i - w);
+    if (i + w < num_cells() && passable(i + w)) f(i + w);
+  }
+
+  // Call f(n, cost) for every traversable 4-neighbour n of cell i, in the
+  // same order as for_each_neighbour.  Reads only the edge cost planes: an
+  // edge to a barrier or off the map is infinite.
+  template <typename F>
+  void for_each_edge(std::size_t i, F f) const {
+    const std::size_t w = length(0);
+    const float* east = &m_costs.east[0];
+    const float* south = &m_costs.south[0];
+    float c;
+    if (i > 0 && (c = east[i - 1]) != kBarrierCost) f(i - 1, c);
+    if ((c = east[i]) != kBarrierCost) f(i + 1, c);
+    if (i >= w && (c = south[i - w]) != kBarrierCost) f(i - w, c);
+    if ((c = south[i]) != kBarrierCost) f(i + w, c);
+  }
+
+  bool solve(vertex_descriptor source, vertex_descriptor goal, search_trace* trace = nullptr,
+             search_stats* stats = nullptr);
   bool solved() const {return !m_solution.empty();}
   bool solution_contains(vertex_descriptor u) const {
     return m_solution.find(u) != m_solution.end();
@@ -118,15 +261,16 @@ public:
 
   // Filter the barrier vertices out of the underlying grid.
   filtered_grid create_barrier_grid() {
-    return boost::make_vertex_subset_complement_filter(m_grid, m_barriers);
+    return boost::make_filtered_graph(m_grid, boost::keep_all(), passable_filter(&m_passable, m_grid.length(0)));
   }
 
-  double timeWeight(const vertex_descriptor& source, const vertex_descriptor& target, const std::vector<uint8_t>& elevation)
+  template <typename Elevation>
+  double timeWeight(const vertex_descriptor& source, const vertex_descriptor& target, const Elevation& elevation)
   {
     double stepTime = 0;
-    bool diag = (abs(source[0]-target[0]) == abs(source[1]-target[1])) ? 1 : 0;
-    auto sourceElevation = static_cast<int>(elevation[source[0]+source[1]*IMAGE_DIM]);
-    auto targetElevation = static_cast<int>(elevation[target[0]+target[1]*IMAGE_DIM]);
+    bool diag = (source[0] != target[0] && source[1] != target[1]) ? 1 : 0;
+    auto sourceElevation = static_cast<int>(elevation[index(source)]);
+    auto targetElevation = static_cast<int>(elevation[index(target)]);
   
     //check for water or flat
     if(sourceElevation == 0 || targetElevation == 0)
@@ -175,12 +319,18 @@ public:
   // The grid underlying the maze
   grid m_grid;
 
-  std::vector<uint8_t> m_elev;
+  cell_vector<uint8_t> m_elev;
+  // One bit per cell (bit i % 64 of word i / 64), set where the rover may drive
+  cell_vector<uint64_t> m_passable;
+  std::size_t m_barrier_count;
+  // Connected region of every cell, see component()
+  cell_vector<uint32_t> m_component;
+  std::size_t m_component_count;
+  // East and south travel times of every cell
+  edge_cost_planes m_costs;
 
   // The underlying maze grid with barrier vertices filtered out
   filtered_grid m_barrier_grid;
-  // The barriers in the maze
-  vertex_set m_barriers;
   // The vertices on a solution path through the maze
   vertex_set m_solution;
   // The length of the solution path
@@ -198,7 +348,7 @@ public:
 manhattan_heuristic(vertex_descriptor goal):m_goal(goal) {};
 
 double operator()(vertex_descriptor v) {
-return 1*(double(abs(m_goal[0] - v[0]) + double(abs(m_goal[1] - v[1]))));
+return 1*(double(std::abs(long(m_goal[0]) - long(v[0])) + double(std::abs(long(m_goal[1]) - long(v[1])))));
 }
 
 private:
@@ -222,13 +372,93 @@ private:
   vertex_descriptor m_goal;
 };
 
+// Goal visitor that also records the search into a search_trace
+template <typename DistanceMap>
+struct astar_trace_visitor:public astar_goal_visitor {
+  astar_trace_visitor(vertex_descriptor goal, const maze& m, search_trace& trace, DistanceMap dist):
+    astar_goal_visitor(goal), m_maze(m), m_trace(trace), m_dist(dist) {};
+
+  void discover_vertex(vertex_descriptor u, const filtered_grid&) {
+    m_trace.state[m_maze.index(u)] = search_trace::OPEN;
+    m_trace.g[m_maze.index(u)] = float(get(m_dist, u));
+  }
+
+  void edge_relaxed(filtered_grid::edge_descriptor e, const filtered_grid& g) {
+    vertex_descriptor v = boost::target(e, g);
+    m_trace.g[m_maze.index(v)] = float(get(m_dist, v));
+  }
+
+  void examine_vertex(vertex_descriptor u, const filtered_grid& g) {
+    m_trace.order[m_maze.index(u)] = ++m_trace.expansions;
+    astar_goal_visitor::examine_vertex(u, g);
+  }
+
+  void finish_vertex(vertex_descriptor u, const filtered_grid&) {
+    m_trace.state[m_maze.index(u)] = search_trace::CLOSED;
+  }
+
+private:
+  const maze& m_maze;
+  search_trace& m_trace;
+  DistanceMap m_dist;
+};
+
+
+
+// Wraps another A* visitor and counts what the search does into a
+// search_stats.
+template <typename Visitor>
+struct astar_stats_visitor:public Visitor {
+  astar_stats_visitor(const Visitor& visitor, search_stats& stats):Visitor(visitor), m_stats(stats) {};
+
+  void discover_vertex(vertex_descriptor u, const filtered_grid& g) {
+    m_stats.pushed();
+    Visitor::discover_vertex(u, g);
+  }
+
+  void edge_relaxed(filtered_grid::edge_descriptor e, const filtered_grid& g) {
+    m_stats.relaxed();
+    Visitor::edge_relaxed(e, g);
+  }
+
+  // A closed vertex whose distance improved goes back on the heap
+  void black_target(filtered_grid::edge_descriptor e, const filtered_grid& g) {
+    m_stats.pushed();
+    Visitor::black_target(e, g);
+  }
+
+  void examine_vertex(vertex_descriptor u, const filtered_grid& g) {
+    m_stats.expanded();
+    Visitor::examine_vertex(u, g);
+  }
+
+private:
+  search_stats& m_stats;
+};
+
 
 
 // Solve the maze using A-star search.  Return true if a solution was found.
-bool maze::solve(vertex_descriptor source, vertex_descriptor goal) {
-  //boost::static_property_map<distance> weight(1);
+// If trace is given, it records the cells the search touched.  If stats is
+// given, the query and its search and path extraction phases are added to it.
+bool maze::solve(vertex_descriptor source, vertex_descriptor goal, search_trace* trace,
+                 search_stats* stats) {
+  if (!kSearchStatsEnabled)
+    stats = nullptr;
+  if (stats)
+    stats->begin_query("solve (" + std::to_string(source[0]) + ", " + std::to_string(source[1]) + ") -> (" +
+                       std::to_string(goal[0]) + ", " + std::to_string(goal[1]) + ")");
+  // Nothing to search if the two cells are on different islands; recorded
+  // as a query that expanded nothing
+  if (!connected(index(source), index(goal))) {
+    stats_phase(stats, "search", true).stop();
+    if (stats)
+      stats->end_query(0);
+    return false;
+  }
+  // One precomputed cost per edge, from the planes every other search reads
   auto weight = boost::make_function_property_map<filtered_grid::edge_descriptor>([this](filtered_grid::edge_descriptor e) {
-        return timeWeight(boost::source(e, m_barrier_grid), boost::target(e, m_barrier_grid), m_elev);});
+        return stepCost(index(boost::source(e, m_barrier_grid)), index(boost::target(e, m_barrier_grid)));});
   // The predecessor map is a vertex-to-vertex mapping.
   typedef boost::unordered_map<vertex_descriptor,
                                vertex_descriptor,
@@ -245,50 +475,182 @@ bool maze::solve(vertex_descriptor source, vertex_descriptor goal) {
   manhattan_heuristic heuristic(goal);
   astar_goal_visitor visitor(goal);
 
-  try {
+  auto search = [&](auto search_visitor) {
     astar_search(m_barrier_grid, source, heuristic,
                  boost::weight_map(weight).
                  predecessor_map(pred_pmap).
                  distance_map(dist_pmap).
-                 visitor(visitor) );  
+                 visitor(search_visitor) );
+  };
+  // Rough peak footprint: the two hash maps plus the cost, colour and heap
+  // index arrays astar_search allocates per vertex.
+  auto scratch_bytes = [&]() {
+    return (predecessor.size() + distance.size())*(sizeof(vertex_descriptor) + 3*sizeof(void*)) +
+           (predecessor.bucket_count() + distance.bucket_count())*sizeof(void*) +
+           num_cells()*(sizeof(double) + sizeof(boost::default_color_type) + sizeof(std::size_t));
+  };
+  try {
+    stats_phase phase(stats, "search", true);
+    if (trace) {
+      trace->reset(num_cells());
+      astar_trace_visitor<boost::associative_property_map<dist_map> >
+        trace_visitor(goal, *this, *trace, dist_pmap);
+      if (stats)
+        search(astar_stats_visitor<decltype(trace_visitor)>(trace_visitor, *stats));
+      else
+        search(trace_visitor);
+    } else {
+      if (stats)
+        search(astar_stats_visitor<astar_goal_visitor>(visitor, *stats));
+      else
+        search(visitor);
+    }
     
   } catch(found_goal fg) {
+    stats_phase phase(stats, "path extraction", true);
     // Walk backwards from the goal through the predecessor chain adding
     // vertices to the solution path.
     for (vertex_descriptor u = goal; u != source; u = predecessor[u])
       m_solution.insert(u);
     m_solution.insert(source);
     m_solution_length = distance[goal];
+    if (stats)
+      stats->end_query(scratch_bytes());
     return true;
   }
 
+  if (stats)
+    stats->end_query(scratch_bytes());
   return false;
 }
 
 
-// Generate a maze with a random assignment of barriers.
-maze make_maze(std::size_t x, std::size_t y, const std::vector<uint8_t>& overrides, std::vector<uint8_t>& elevation) {
-  maze m(IMAGE_DIM, IMAGE_DIM, elevation);
-  auto Obegin = overrides.begin();
-  vertex_descriptor u;
-  int count = 0;
-  auto Ebegin = elevation.begin();
-  for(auto i = overrides.begin(); i != overrides.end(); ++i)
-  {
-      if((*i & (OF_WATER_BASIN | OF_RIVER_MARSH)) || (elevation[i-Obegin] == 0))
-      {
-          count++;
-          auto xBarr = (i - Obegin)%IMAGE_DIM;
-          auto yBarr = ((i - Obegin) - xBarr)/IMAGE_DIM;
-
-          //std::cout << "barriers are at " << xBarr <<", "<<yBarr <<std::endl;
-
-          u = vertex((i-Obegin), m.m_grid);
-          m.m_barriers.insert(u);
+// Build the maze for an x by y map.
+//
+// A cell is a barrier if it is water or marsh, or has zero elevation.  The
+// rows are split into one band per thread.  Each band sweeps its rows once.
+// It classifies 16 or 32 cells at a time into the passable bitmap, fills
+// the edge cost planes, and collects runs of passable cells that it joins
+// with the runs of the row above.  The per-band runs are then joined across
+// band edges and numbered, and each band writes its component labels.
+maze make_maze(std::size_t x, std::size_t y, const std::vector<uint8_t>& overrides,
+               const std::vector<uint8_t>& elevation, unsigned threads = default_threads()) {
+  using namespace detail;
+  maze m(x, y, elevation);
+  const std::size_t cells = x*y;
+  const uint8_t blockMask = OF_WATER_BASIN | OF_RIVER_MARSH;
+  m.m_passable.assign((cells + 63)/64 + 1, 0);
+  m.m_component.resize(cells);
+  m.m_costs.east.resize(cells);
+  m.m_costs.south.resize(cells);
+
+  // Bands start on rows whose first cell opens a bitmap word, so that no
+  // two threads write the same word.
+  std::size_t rowStep = 1;
+  while ((rowStep*x) % 64 != 0)
+    rowStep *= 2;
+  threads = unsigned(std::max<std::size_t>(1, std::min<std::size_t>(threads, (y + rowStep - 1)/rowStep)));
+  std::vector<std::size_t> bands(threads + 1, y);
+  for (unsigned t = 0; t < threads; ++t)
+    bands[t] = std::min(y, (y*t/threads + rowStep - 1)/rowStep*rowStep);
+
+  struct band_state {
+    std::vector<cell_run> runs;
+    // Index in runs of the first run of each row of the band, plus the end
+    std::vector<std::size_t> rowStart;
+    run_union_find sets;
+    std::size_t barriers;
+  };
+  std::vector<band_state> state(threads);
+  const uint8_t* ov = &overrides[0];
+  const uint8_t* ev = &m.m_elev[0];
+  uint64_t* bits = &m.m_passable[0];
+
+  parallel_invoke(threads, [&](unsigned t) {
+    band_state& band = state[t];
+    band.barriers = 0;
+    const std::size_t first = bands[t], last = bands[t + 1];
+    if (first == last)
+      return;
+    std::vector<uint8_t> current(x), next(x);
+    band.barriers += classifyRow(ov + first*x, ev + first*x, x, blockMask, &current[0], bits, first*x);
+    for (std::size_t r = first; r < last; ++r) {
+      const bool below = r + 1 < y;
+      if (below) {
+        // The row below is classified again by its own band if it is not ours
+        std::size_t n = classifyRow(ov + (r + 1)*x, ev + (r + 1)*x, x, blockMask, &next[0],
+                                    r + 1 < last ? bits : nullptr, (r + 1)*x);
+        if (r + 1 < last)
+          band.barriers += n;
+      }
+      build_edge_cost_row(m.m_costs, r, x, ev + r*x, &current[0], below ? ev + (r + 1)*x : nullptr,
+                          below ? &next[0] : nullptr, stepTimeTable(1), nullptr);
+
+      band.rowStart.push_back(band.runs.size());
+      appendRuns(&current[0], x, uint32_t(r), band.runs);
+      while (band.sets.size() < band.runs.size())
+        band.sets.add();
+      if (r > first) {
+        const std::size_t* rows = &band.rowStart[band.rowStart.size() - 2];
+        joinRows(band.runs, rows[0], rows[1], rows[1], band.runs.size(), 0, band.sets);
+      }
+      current.swap(next);
+    }
+    band.rowStart.push_back(band.runs.size());
+  });
+
+  // Join the bands along their shared edges and number the components in
+  // the order their first run appears.
+  run_union_find sets;
+  std::vector<uint32_t> firstId(threads + 1, 0);
+  m.m_barrier_count = 0;
+  for (unsigned t = 0; t < threads; ++t) {
+    firstId[t] = uint32_t(sets.size());
+    sets.append(state[t].sets);
+    m.m_barrier_count += state[t].barriers;
+  }
+  for (unsigned upperBand = 0, t = 1; t < threads; ++t) {
+    if (bands[t] == bands[t + 1])
+      continue;
+    // Last row of the band above (skipping empty ones) against our first row
+    const band_state& upper = state[upperBand];
+    const band_state& lower = state[t];
+    std::size_t a = upper.rowStart.empty() ? 0 : upper.rowStart[upper.rowStart.size() - 2];
+    std::size_t b = 0;
+    while (a < upper.runs.size() && b < lower.rowStart[1]) {
+      if (upper.runs[a].begin < lower.runs[b].end && lower.runs[b].begin < upper.runs[a].end)
+        sets.unite(firstId[upperBand] + uint32_t(a), firstId[t] + uint32_t(b));
+      if (upper.runs[a].end < lower.runs[b].end)
+        ++a;
+      else
+        ++b;
+    }
+    upperBand = t;
+  }
+  std::vector<uint32_t> label(sets.size(), 0);
+  uint32_t components = 0;
+  for (uint32_t id = 0; id < sets.size(); ++id) {
+    uint32_t root = sets.find(id);
+    if (label[root] == 0)
+      label[root] = ++components;
+    label[id] = label[root];
+  }
+  m.m_component_count = components;
+
+  parallel_invoke(threads, [&](unsigned t) {
+    const band_state& band = state[t];
+    uint32_t* out = &m.m_component[0];
+    for (std::size_t r = bands[t]; r < bands[t + 1]; ++r) {
+      std::size_t cursor = r*x;
+      for (std::size_t k = band.rowStart[r - bands[t]]; k < band.rowStart[r - bands[t] + 1]; ++k) {
+        const cell_run& run = band.runs[k];
+        std::fill(out + cursor, out + r*x + run.begin, 0u);
+        std::fill(out + r*x + run.begin, out + r*x + run.end, label[firstId[t] + k]);
+        cursor = r*x + run.end;
       }
+      std::fill(out + cursor, out + (r + 1)*x, 0u);
     }
-    std::cout<<std::endl;
-    std::cout << "Number of non-traversable cells: " << count << std::endl;
+  });
   return m;
 }
 
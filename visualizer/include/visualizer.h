@@ -1,8 +1,15 @@
 #ifndef __VISUALIZER_H__
 #define __VISUALIZER_H__
 
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
 #include <vector>
-#include <functional>
 #include <ostream>
 
 namespace visualizer {
@@ -15,10 +22,134 @@ enum ImagePixelValues
     IPV_ELEVATION_BEGIN = 2     // 2-255
 };
 
+// Pixel values of the heatmap colormap
+enum HeatPixelValues
+{
+    HPV_PATH = 0,               // Red, same as IPV_PATH
+    HPV_WATER = 1,              // Same as IPV_WATER
+    HPV_UNVISITED = 2,          // Dark grey
+    HPV_HEAT_BEGIN = 3          // 3-255, cold to hot
+};
+
+// Colormap for elevation maps, RGB triplets indexed by ImagePixelValues
+std::vector<uint8_t> generateElevationColormap();
+
+// Colormap for heatmaps, RGB triplets indexed by HeatPixelValues
+std::vector<uint8_t> generateHeatColormap();
+
+
+namespace detail {
+
+// Size in bytes of one pixel row, padded to a multiple of 4
+inline size_t bmpRowBytes(size_t width)
+{
+    return ((8 * width + 31) / 32) * 4;
+}
+
+/**
+ * Writes the BMP file header and the elevation colormap, leaving the stream at the start
+ * of the pixel array.
+ */
+void writeBMPHeader(std::ostream& out, size_t width, size_t height);
+
+// Same as above with another colormap, given as RGB triplets
+void writeBMPHeader(
+    std::ostream& out,
+    size_t width,
+    size_t height,
+    const std::vector<uint8_t>& colormap);
+
+// A BMP file mapped into memory, sized and with its header already written
+struct MappedBMP
+{
+    void* base;
+    size_t size;
+    uint8_t* pixels;
+};
+
+/**
+ * Creates (or truncates) the file at path, sizes it for a width x height image and maps
+ * it. Returns false if the file cannot be created or mapped.
+ */
+bool mapBMPFile(const char* path, size_t width, size_t height, MappedBMP& mapped);
+
+// Flushes and unmaps a file mapped with mapBMPFile
+bool unmapBMPFile(MappedBMP& mapped);
+
+/**
+ * Fills the BMP pixel array (last row first, rows padded), splitting the rows into one
+ * block per thread. renderRow(y, row) must fill the width pixels of row y (from the top).
+ * The result does not depend on the number of threads.
+ */
+template <typename RowRenderer>
+void renderImage(
+    uint8_t* image,
+    size_t width,
+    size_t height,
+    RowRenderer& renderRow,
+    unsigned threads)
+{
+    size_t rowBytes = bmpRowBytes(width);
+    auto renderBlock = [&](size_t firstRow, size_t lastRow) {
+        for (size_t y = firstRow; y < lastRow; ++ y)
+        {
+            uint8_t* row = image + (height - 1 - y) * rowBytes;
+            renderRow(y, row);
+            for (size_t x = width; x < rowBytes; ++ x)
+            {
+                row[x] = 0;
+            }
+        }
+    };
+    
+    threads = unsigned(std::max<size_t>(1, std::min<size_t>(threads, height)));
+    std::vector<std::thread> workers;
+    for (unsigned t = 1; t < threads; ++ t)
+    {
+        workers.emplace_back(renderBlock, height * t / threads, height * (t + 1) / threads);
+    }
+    renderBlock(0, height / threads);
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+// Adapts a per-pixel filter to renderImage
+template <typename PixelFilter>
+struct FilterRows
+{
+    const uint8_t* elevationData;
+    size_t width;
+    PixelFilter& pixelFilter;
+    
+    void operator()(size_t y, uint8_t* row)
+    {
+        const uint8_t* pixels = elevationData + y * width;
+        for (size_t x = 0; x < width; ++ x)
+        {
+            row[x] = pixelFilter(x, y, pixels[x]);
+        }
+    }
+};
+
+template <typename PixelFilter>
+FilterRows<PixelFilter> filterRows(const uint8_t* elevationData, size_t width, PixelFilter& pixelFilter)
+{
+    return FilterRows<PixelFilter>{elevationData, width, pixelFilter};
+}
+
+} // namespace detail
+
 
 /**
  * A method to write BMP file contents to a specified ostream.
  *
+ * The whole pixel array, padding included, is composed in one buffer and written with a
+ * single call. The filter is a template parameter so that lambdas are inlined into the
+ * pixel loop. With more than one thread, blocks of rows are rendered in parallel, so the
+ * filter must be safe to call concurrently; the output is the same either way.
+ *
  * @param out The ostream to use for output. Could be directed into anything
  * @param elevationData Pointer to grid of elevation values. There must be width * height such
  *        elevation points.
@@ -27,15 +158,384 @@ enum ImagePixelValues
  * @param pixelFilter A passed function or lambda that can change the pixel colormap index at passed
  *        x (from the left), and y (from the top) position of the elevationData. See enum
  *        ImagePixelValues above for interesting values to return.
+ * @param threads Number of threads rendering rows
+ */
+template <typename PixelFilter>
+void writeBMP(
+    std::ostream& out,
+    const uint8_t* elevationData,
+    size_t width,
+    size_t height,
+    PixelFilter pixelFilter,
+    unsigned threads = 1)
+{
+    detail::writeBMPHeader(out, width, height);
+    std::vector<uint8_t> image(detail::bmpRowBytes(width) * height);
+    auto renderRow = detail::filterRows(elevationData, width, pixelFilter);
+    detail::renderImage(&image[0], width, height, renderRow, threads);
+    out.write((const char*)image.data(), image.size());
+}
+
+/**
+ * Same as writeBMP, but renders straight into a memory mapped output file, so the image
+ * is never copied. Returns false if the file could not be created.
+ */
+template <typename PixelFilter>
+bool writeBMPFile(
+    const char* path,
+    const uint8_t* elevationData,
+    size_t width,
+    size_t height,
+    PixelFilter pixelFilter,
+    unsigned threads = 1)
+{
+    detail::MappedBMP mapped;
+    if (!detail::mapBMPFile(path, width, height, mapped))
+    {
+        return false;
+    }
+    auto renderRow = detail::filterRows(elevationData, width, pixelFilter);
+    detail::renderImage(mapped.pixels, width, height, renderRow, threads);
+    return detail::unmapBMPFile(mapped);
+}
+
+
+/**
+ * A layer drawn over the elevation map.
+ *
+ * Shapes are rasterised once into a value plane and a mask plane, so drawing costs time
+ * proportional to the shape, and compositing costs a couple of bitwise operations per
+ * pixel no matter how much was drawn. Pixels that were never drawn show the layers below.
+ */
+class Overlay
+{
+public:
+    Overlay(size_t width, size_t height);
+    
+    size_t width() const { return m_width; }
+    size_t height() const { return m_height; }
+    
+    void setPixel(size_t x, size_t y, uint8_t value)
+    {
+        if (x < m_width && y < m_height)
+        {
+            m_values[y * m_width + x] = value;
+            m_mask[y * m_width + x] = 0xFF;
+        }
+    }
+    
+    // Draws every point in [first, last); points are indexable as p[0] == x, p[1] == y
+    template <typename Iterator>
+    void drawPoints(Iterator first, Iterator last, uint8_t value)
+    {
+        for (; first != last; ++ first)
+        {
+            setPixel((*first)[0], (*first)[1], value);
+        }
+    }
+    
+    // Draws straight lines between consecutive points, e.g. any-angle waypoints
+    template <typename Iterator>
+    void drawPolyline(Iterator first, Iterator last, uint8_t value)
+    {
+        if (first == last)
+        {
+            return;
+        }
+        Iterator previous = first;
+        setPixel((*first)[0], (*first)[1], value);
+        for (++ first; first != last; previous = first, ++ first)
+        {
+            drawLine((*previous)[0], (*previous)[1], (*first)[0], (*first)[1], value);
+        }
+    }
+    
+    // Bresenham line between two pixels, both ends included
+    void drawLine(size_t x0, size_t y0, size_t x1, size_t y1, uint8_t value);
+    
+    // Ring of pixels whose squared distance from (x, y) lies in [innerRadius2, outerRadius2]
+    void stampDonut(size_t x, size_t y, size_t innerRadius2, size_t outerRadius2, uint8_t value);
+    
+    // Draws every pixel i (row-major) for which covered(i) is true
+    template <typename Predicate>
+    void drawWhere(Predicate covered, uint8_t value)
+    {
+        for (size_t i = 0; i < m_values.size(); ++ i)
+        {
+            if (covered(i))
+            {
+                m_values[i] = value;
+                m_mask[i] = 0xFF;
+            }
+        }
+    }
+    
+    /**
+     * Draws contour lines of a plane of per-pixel values, such as arrival times, one every
+     * step. A pixel is on a line when a 4-neighbour lies in a lower band of width step.
+     * Infinite or NaN values are below every band, so the edge of the finite region is
+     * outlined too.
+     */
+    void drawContours(const float* values, float step, uint8_t value);
+    
+    // Writes this layer over row y of an image
+    void compositeRow(size_t y, uint8_t* row) const
+    {
+        const uint8_t* values = &m_values[y * m_width];
+        const uint8_t* mask = &m_mask[y * m_width];
+        for (size_t x = 0; x < m_width; ++ x)
+        {
+            row[x] = uint8_t((row[x] & ~mask[x]) | (values[x] & mask[x]));
+        }
+    }
+    
+private:
+    size_t m_width;
+    size_t m_height;
+    std::vector<uint8_t> m_values;
+    std::vector<uint8_t> m_mask;
+};
+
+namespace detail {
+
+// Elevation clamped into the elevation colormap range, then every layer in order
+struct LayerRows
+{
+    const uint8_t* elevationData;
+    size_t width;
+    const std::vector<const Overlay*>& layers;
+    
+    void operator()(size_t y, uint8_t* row)
+    {
+        const uint8_t* pixels = elevationData + y * width;
+        for (size_t x = 0; x < width; ++ x)
+        {
+            row[x] = std::max(pixels[x], uint8_t(IPV_ELEVATION_BEGIN));
+        }
+        for (const Overlay* layer : layers)
+        {
+            layer->compositeRow(y, row);
+        }
+    }
+};
+
+} // namespace detail
+
+/**
+ * Writes the elevation map with the given overlays on top, later layers covering earlier
+ * ones. Every layer must have the size of the map.
  */
 void writeBMP(
     std::ostream& out,
     const uint8_t* elevationData,
     size_t width,
     size_t height,
-    std::function<uint8_t(size_t, size_t, uint8_t)> pixelFilter);
+    const std::vector<const Overlay*>& layers,
+    unsigned threads = 1);
+
+// Same as above, rendering into a memory mapped file
+bool writeBMPFile(
+    const char* path,
+    const uint8_t* elevationData,
+    size_t width,
+    size_t height,
+    const std::vector<const Overlay*>& layers,
+    unsigned threads = 1);
+
+
+/**
+ * Writes a plane of per-pixel values as a heatmap, e.g. the expansion order or g-values a
+ * search recorded. Finite values are scaled linearly from their minimum (cold) to their
+ * maximum (hot); infinite or NaN values are drawn as unvisited. Layers are drawn on top as
+ * with writeBMP, using HeatPixelValues.
+ */
+void writeHeatmapBMP(
+    std::ostream& out,
+    const float* values,
+    size_t width,
+    size_t height,
+    const std::vector<const Overlay*>& layers,
+    unsigned threads = 1);
 
 
+// A path in full resolution pixel coordinates, drawn as straight lines between points
+typedef std::vector<std::array<size_t, 2> > Polyline;
+
+// How a tile pyramid combines 2x2 pixels into one at the next zoom level out. Markers
+// are not elevations and are never mixed into them: a path pixel wins over everything,
+// then water by the rule below, and only the elevation pixels are filtered.
+enum DownsampleFilter
+{
+    DOWNSAMPLE_MAX,             // Highest elevation; water only where all four are water
+    DOWNSAMPLE_MEAN             // Mean elevation; water where at least three are water
+};
+
+struct PyramidOptions
+{
+    size_t tileSize = 256;
+    DownsampleFilter filter = DOWNSAMPLE_MAX;
+    unsigned threads = 1;
+};
+
+namespace detail {
+
+/**
+ * The non-template part of writeTilePyramid: zoom arithmetic, 2x2 downsampling, paths
+ * rasterised per zoom level and bucketed per tile, and writing finished tiles.
+ */
+class PyramidWriter
+{
+public:
+    PyramidWriter(
+        const char* directory,
+        size_t width,
+        size_t height,
+        const std::vector<Polyline>& paths,
+        const PyramidOptions& options);
+    
+    size_t tileSize() const { return m_options.tileSize; }
+    unsigned maxZoom() const { return m_maxZoom; }
+    // Number of tiles along each axis at zoom z
+    size_t tilesAcross(unsigned z) const { return size_t(1) << z; }
+    
+    // Combines the four children (top-left, top-right, bottom-left, bottom-right) of a tile
+    void downsample(const std::vector<uint8_t>* children[4], std::vector<uint8_t>& tile) const;
+    
+    // Draws the paths over a copy of the tile and writes it to directory/z/x/y.bmp
+    bool writeTile(unsigned z, size_t tx, size_t ty, const std::vector<uint8_t>& tile) const;
+    
+private:
+    std::string m_directory;
+    PyramidOptions m_options;
+    unsigned m_maxZoom;
+    // Per zoom level: tile key -> path pixels inside the tile, packed as y * tileSize + x
+    std::vector<std::unordered_map<uint64_t, std::vector<uint32_t> > > m_pathPixels;
+};
+
+// Builds tile (z, tx, ty) and everything under it, writing each tile as it completes.
+// Only the tiles on the current branch of the quadtree are held in memory.
+template <typename PixelSource>
+bool buildTile(
+    const PyramidWriter& writer,
+    size_t width,
+    size_t height,
+    PixelSource& source,
+    unsigned z,
+    size_t tx,
+    size_t ty,
+    std::vector<uint8_t>& tile)
+{
+    size_t T = writer.tileSize();
+    tile.resize(T * T);
+    if (z == writer.maxZoom())
+    {
+        for (size_t y = 0; y < T; ++ y)
+        {
+            for (size_t x = 0; x < T; ++ x)
+            {
+                size_t px = tx * T + x, py = ty * T + y;
+                tile[y * T + x] = px < width && py < height ? source(px, py) : uint8_t(IPV_WATER);
+            }
+        }
+        return writer.writeTile(z, tx, ty, tile);
+    }
+    
+    std::vector<uint8_t> children[4];
+    const std::vector<uint8_t>* childPointers[4];
+    bool ok = true;
+    for (int c = 0; c < 4; ++ c)
+    {
+        ok = buildTile(writer, width, height, source, z + 1, 2 * tx + (c & 1), 2 * ty + (c >> 1), children[c]) && ok;
+        childPointers[c] = &children[c];
+    }
+    writer.downsample(childPointers, tile);
+    return writer.writeTile(z, tx, ty, tile) && ok;
+}
+
+} // namespace detail
+
+/**
+ * Writes the map as a pyramid of fixed-size BMP tiles in directory/z/x/y.bmp, where zoom 0
+ * is a single tile covering the whole map and the highest zoom is full resolution. Each
+ * zoom level is downsampled from the one below with the chosen filter, and the paths are
+ * rasterised separately at every level so they stay one pixel wide. Map areas outside
+ * width x height are drawn as water.
+ *
+ * The full resolution image never exists in memory: tiles are produced depth first and
+ * written as soon as they are complete, and subtrees are built in parallel.
+ *
+ * @param source Callable returning the colormap index (see ImagePixelValues) of the full
+ *        resolution pixel at x, y. Called concurrently when using more than one thread.
+ */
+template <typename PixelSource>
+bool writeTilePyramid(
+    const char* directory,
+    size_t width,
+    size_t height,
+    PixelSource source,
+    const std::vector<Polyline>& paths,
+    const PyramidOptions& options = PyramidOptions())
+{
+    detail::PyramidWriter writer(directory, width, height, paths, options);
+    
+    // Subtrees rooted at the split level are independent; build them in parallel, then
+    // combine the levels above.
+    unsigned split = 0;
+    while (split < writer.maxZoom() && (size_t(1) << (2 * split)) < 4 * size_t(options.threads))
+    {
+        ++ split;
+    }
+    size_t across = writer.tilesAcross(split);
+    std::vector<std::vector<uint8_t> > level(across * across);
+    std::atomic<size_t> next(0);
+    std::atomic<bool> ok(true);
+    auto work = [&] {
+        size_t i;
+        while ((i = next.fetch_add(1)) < level.size())
+        {
+            if (!detail::buildTile(writer, width, height, source, split, i % across, i / across, level[i]))
+            {
+                ok = false;
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned t = 1; t < options.threads; ++ t)
+    {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+    
+    while (split -- > 0)
+    {
+        size_t childAcross = across;
+        across = writer.tilesAcross(split);
+        std::vector<std::vector<uint8_t> > parents(across * across);
+        for (size_t ty = 0; ty < across; ++ ty)
+        {
+            for (size_t tx = 0; tx < across; ++ tx)
+            {
+                const std::vector<uint8_t>* children[4];
+                for (int c = 0; c < 4; ++ c)
+                {
+                    children[c] = &level[(2 * ty + (c >> 1)) * childAcross + 2 * tx + (c & 1)];
+                }
+                std::vector<uint8_t>& tile = parents[ty * across + tx];
+                writer.downsample(children, tile);
+                if (!writer.writeTile(split, tx, ty, tile))
+                {
+                    ok = false;
+                }
+            }
+        }
+        level.swap(parents);
+    }
+    return ok;
+}
 
 } // namespace visualizer
 
@@ -5,6 +5,26 @@
 #include <assert.h>
 #include <array>
 #include <string.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cmath>
+#include <limits>
+
+#ifdef _WIN32
+#include <direct.h>
+#define makeDirectory(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define makeDirectory(path) mkdir(path, 0755)
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define VISUALIZER_HAS_MMAP
+#endif
 
 
 namespace visualizer {
@@ -39,19 +59,17 @@ typedef struct {
 } bitmap;
 #pragma pack(pop)
 
-void writeBMP(
+void writeBMPHeader(
     std::ostream& out,
     size_t width,
     size_t height,
-    const uint8_t* pixels,
     const uint8_t* colormap,
-    size_t colormapSize,
-    std::function<uint8_t(size_t, size_t, uint8_t)> pixelFilter)
+    size_t colormapSize)
 {
     size_t colormapSizeBytes = 4 * colormapSize;
     size_t offsetPixels = ((sizeof(bitmap) + colormapSizeBytes + 3) / 4) * 4;
     size_t bitsPerPixel = 8;
-    size_t rowBytes = ((bitsPerPixel * width + 31) / 32) * 4;
+    size_t rowBytes = detail::bmpRowBytes(width);
     size_t pixelBytes = rowBytes * height;
     size_t fileSize = offsetPixels + pixelBytes;
     
@@ -91,26 +109,6 @@ void writeBMP(
         const char* filler = "FIL";
         out.write(filler + rest - 1, 4 - rest);
     }
-    
-    // Write pixels, last row first
-    char fill[32];
-    memset(fill, ' ', sizeof(fill));
-    fill[rowBytes - width] = 0;
-    pixels = pixels + (height - 1) * width;
-    while (height --)
-    {
-        size_t left = width;
-        size_t x = 0;
-        while (left --)
-        {
-            uint8_t pixelValue = pixelFilter(x, height, *pixels);
-            out.write((const char*)&pixelValue, 1);
-            ++ pixels;
-            ++ x;
-        }
-        pixels -= 2 * width;
-        out << fill;
-    }
 }
 
 uint8_t maxImage(
@@ -193,16 +191,398 @@ std::vector<uint8_t> generateElevationColormap()
 }
 
 
+std::vector<uint8_t> generateHeatColormap()
+{
+    std::vector<uint8_t> result(256 * 3);
+    
+    setColor(result, HPV_PATH, 255, 0, 0);
+    setColor(result, HPV_WATER, 53, 160, 198);
+    setColor(result, HPV_UNVISITED, 40, 40, 40);
+    
+    // Blue to cyan to yellow to red
+    blendColor(result, HPV_HEAT_BEGIN, 87, 20, 30, 140, 0, 190, 220);
+    blendColor(result, 87, 171, 0, 190, 220, 250, 220, 40);
+    blendColor(result, 171, 256, 250, 220, 40, 200, 20, 20);
+    
+    return result;
+}
+
+
+namespace detail {
+
+void writeBMPHeader(std::ostream& out, size_t width, size_t height)
+{
+    writeBMPHeader(out, width, height, generateElevationColormap());
+}
+
+void writeBMPHeader(
+    std::ostream& out,
+    size_t width,
+    size_t height,
+    const std::vector<uint8_t>& colormap)
+{
+    visualizer::writeBMPHeader(out, width, height, &colormap[0], colormap.size()/3);
+}
+
+bool mapBMPFile(const char* path, size_t width, size_t height, MappedBMP& mapped)
+{
+    std::ostringstream header;
+    writeBMPHeader(header, width, height);
+    std::string headerBytes = header.str();
+    size_t fileSize = headerBytes.size() + bmpRowBytes(width) * height;
+    
+#ifdef VISUALIZER_HAS_MMAP
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+    if (ftruncate(fd, fileSize) != 0)
+    {
+        close(fd);
+        return false;
+    }
+    void* base = mmap(NULL, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        return false;
+    }
+#else
+    // No mmap: render into memory and write the file when unmapping
+    void* base = malloc(fileSize + strlen(path) + 1);
+    if (base == NULL)
+    {
+        return false;
+    }
+    strcpy((char*)base + fileSize, path);
+#endif
+    memcpy(base, headerBytes.data(), headerBytes.size());
+    mapped.base = base;
+    mapped.size = fileSize;
+    mapped.pixels = (uint8_t*)base + headerBytes.size();
+    return true;
+}
+
+bool unmapBMPFile(MappedBMP& mapped)
+{
+#ifdef VISUALIZER_HAS_MMAP
+    bool ok = munmap(mapped.base, mapped.size) == 0;
+#else
+    std::ofstream out((const char*)mapped.base + mapped.size, std::ofstream::binary);
+    out.write((const char*)mapped.base, mapped.size);
+    bool ok = out.good();
+    free(mapped.base);
+#endif
+    mapped.base = NULL;
+    mapped.pixels = NULL;
+    return ok;
+}
+
+} // namespace detail
+
+
+Overlay::Overlay(size_t width, size_t height)
+    : m_width(width)
+    , m_height(height)
+    , m_values(width * height)
+    , m_mask(width * height)
+{
+}
+
+void Overlay::drawLine(size_t x0, size_t y0, size_t x1, size_t y1, uint8_t value)
+{
+    long x = x0, y = y0;
+    long dx = labs(long(x1) - x), dy = -labs(long(y1) - y);
+    long sx = x < long(x1) ? 1 : -1, sy = y < long(y1) ? 1 : -1;
+    long err = dx + dy;
+    while (true)
+    {
+        setPixel(x, y, value);
+        if (x == long(x1) && y == long(y1))
+        {
+            break;
+        }
+        long e2 = 2 * err;
+        if (e2 >= dy)
+        {
+            err += dy;
+            x += sx;
+        }
+        if (e2 <= dx)
+        {
+            err += dx;
+            y += sy;
+        }
+    }
+}
+
+void Overlay::stampDonut(size_t x, size_t y, size_t innerRadius2, size_t outerRadius2, uint8_t value)
+{
+    long r = 0;
+    while (size_t((r + 1) * (r + 1)) <= outerRadius2)
+    {
+        ++ r;
+    }
+    for (long dy = -r; dy <= r; ++ dy)
+    {
+        for (long dx = -r; dx <= r; ++ dx)
+        {
+            size_t r2 = dx * dx + dy * dy;
+            long px = long(x) + dx, py = long(y) + dy;
+            if (r2 >= innerRadius2 && r2 <= outerRadius2 && px >= 0 && py >= 0)
+            {
+                setPixel(px, py, value);
+            }
+        }
+    }
+}
+
+void Overlay::drawContours(const float* values, float step, uint8_t value)
+{
+    auto band = [&](size_t i) {
+        float v = values[i];
+        return v <= std::numeric_limits<float>::max() ? long(std::floor(v / step)) : -1L;
+    };
+    for (size_t y = 0; y < m_height; ++ y)
+    {
+        for (size_t x = 0; x < m_width; ++ x)
+        {
+            size_t i = y * m_width + x;
+            long b = band(i);
+            if (b < 0)
+            {
+                continue;
+            }
+            if ((x > 0 && band(i - 1) < b) || (x + 1 < m_width && band(i + 1) < b) ||
+                (y > 0 && band(i - m_width) < b) || (y + 1 < m_height && band(i + m_width) < b))
+            {
+                m_values[i] = value;
+                m_mask[i] = 0xFF;
+            }
+        }
+    }
+}
+
 void writeBMP(
     std::ostream& out,
     const uint8_t* elevationData,
     size_t width,
     size_t height,
-    std::function<uint8_t(size_t, size_t, uint8_t)> pixelFilter)
+    const std::vector<const Overlay*>& layers,
+    unsigned threads)
 {
-    auto colormap(generateElevationColormap());
-    writeBMP(out, width, height, elevationData, &colormap[0], colormap.size()/3, pixelFilter);
+    detail::writeBMPHeader(out, width, height);
+    std::vector<uint8_t> image(detail::bmpRowBytes(width) * height);
+    detail::LayerRows renderRow{elevationData, width, layers};
+    detail::renderImage(&image[0], width, height, renderRow, threads);
+    out.write((const char*)image.data(), image.size());
+}
+
+bool writeBMPFile(
+    const char* path,
+    const uint8_t* elevationData,
+    size_t width,
+    size_t height,
+    const std::vector<const Overlay*>& layers,
+    unsigned threads)
+{
+    detail::MappedBMP mapped;
+    if (!detail::mapBMPFile(path, width, height, mapped))
+    {
+        return false;
+    }
+    detail::LayerRows renderRow{elevationData, width, layers};
+    detail::renderImage(mapped.pixels, width, height, renderRow, threads);
+    return detail::unmapBMPFile(mapped);
 }
 
 
+void writeHeatmapBMP(
+    std::ostream& out,
+    const float* values,
+    size_t width,
+    size_t height,
+    const std::vector<const Overlay*>& layers,
+    unsigned threads)
+{
+    float low = std::numeric_limits<float>::infinity();
+    float high = -std::numeric_limits<float>::infinity();
+    for (size_t i = 0; i < width * height; ++ i)
+    {
+        if (std::isfinite(values[i]))
+        {
+            low = std::min(low, values[i]);
+            high = std::max(high, values[i]);
+        }
+    }
+    float scale = high > low ? (255 - HPV_HEAT_BEGIN) / (high - low) : 0;
+    
+    auto renderRow = [&](size_t y, uint8_t* row) {
+        const float* rowValues = values + y * width;
+        for (size_t x = 0; x < width; ++ x)
+        {
+            float v = rowValues[x];
+            row[x] = std::isfinite(v) ?
+                uint8_t(HPV_HEAT_BEGIN + unsigned((v - low) * scale)) : uint8_t(HPV_UNVISITED);
+        }
+        for (const Overlay* layer : layers)
+        {
+            layer->compositeRow(y, row);
+        }
+    };
+    
+    detail::writeBMPHeader(out, width, height, generateHeatColormap());
+    std::vector<uint8_t> image(detail::bmpRowBytes(width) * height);
+    detail::renderImage(&image[0], width, height, renderRow, threads);
+    out.write((const char*)image.data(), image.size());
+}
+
+
+namespace detail {
+
+PyramidWriter::PyramidWriter(
+    const char* directory,
+    size_t width,
+    size_t height,
+    const std::vector<Polyline>& paths,
+    const PyramidOptions& options)
+    : m_directory(directory)
+    , m_options(options)
+    , m_maxZoom(0)
+{
+    while ((m_options.tileSize << m_maxZoom) < std::max(width, height))
+    {
+        ++ m_maxZoom;
+    }
+    
+    // Rasterise every path once per zoom level into the tiles it crosses
+    size_t T = m_options.tileSize;
+    m_pathPixels.resize(m_maxZoom + 1);
+    for (unsigned z = 0; z <= m_maxZoom; ++ z)
+    {
+        unsigned shift = m_maxZoom - z;
+        auto& buckets = m_pathPixels[z];
+        size_t across = tilesAcross(z);
+        auto plot = [&](size_t x, size_t y) {
+            uint64_t key = uint64_t(y / T) * across + x / T;
+            buckets[key].push_back(uint32_t((y % T) * T + x % T));
+        };
+        for (const Polyline& path : paths)
+        {
+            for (size_t i = 0; i < path.size(); ++ i)
+            {
+                long x1 = long(path[i][0] >> shift), y1 = long(path[i][1] >> shift);
+                long x = i > 0 ? long(path[i - 1][0] >> shift) : x1;
+                long y = i > 0 ? long(path[i - 1][1] >> shift) : y1;
+                long dx = labs(x1 - x), dy = -labs(y1 - y);
+                long sx = x < x1 ? 1 : -1, sy = y < y1 ? 1 : -1;
+                long err = dx + dy;
+                while (true)
+                {
+                    plot(x, y);
+                    if (x == x1 && y == y1)
+                    {
+                        break;
+                    }
+                    long e2 = 2 * err;
+                    if (e2 >= dy)
+                    {
+                        err += dy;
+                        x += sx;
+                    }
+                    if (e2 <= dx)
+                    {
+                        err += dx;
+                        y += sy;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void PyramidWriter::downsample(const std::vector<uint8_t>* children[4], std::vector<uint8_t>& tile) const
+{
+    size_t T = m_options.tileSize;
+    size_t half = T / 2;
+    tile.resize(T * T);
+    for (size_t y = 0; y < T; ++ y)
+    {
+        for (size_t x = 0; x < T; ++ x)
+        {
+            const std::vector<uint8_t>& child = *children[(y >= half) * 2 + (x >= half)];
+            size_t cx = (x % half) * 2, cy = (y % half) * 2;
+            uint8_t v[4] = {
+                child[cy * T + cx], child[cy * T + cx + 1],
+                child[(cy + 1) * T + cx], child[(cy + 1) * T + cx + 1]};
+            
+            unsigned path = 0, water = 0, land = 0, sum = 0, top = 0;
+            for (int i = 0; i < 4; ++ i)
+            {
+                if (v[i] == IPV_PATH)
+                {
+                    ++ path;
+                }
+                else if (v[i] == IPV_WATER)
+                {
+                    ++ water;
+                }
+                else
+                {
+                    ++ land;
+                    sum += v[i];
+                    top = std::max<unsigned>(top, v[i]);
+                }
+            }
+            uint8_t& out = tile[y * T + x];
+            if (path > 0)
+            {
+                out = IPV_PATH;
+            }
+            else if (land == 0 || (m_options.filter == DOWNSAMPLE_MEAN && water >= 3))
+            {
+                out = IPV_WATER;
+            }
+            else if (m_options.filter == DOWNSAMPLE_MAX)
+            {
+                out = uint8_t(top);
+            }
+            else
+            {
+                out = uint8_t((sum + land / 2) / land);
+            }
+        }
+    }
+}
+
+bool PyramidWriter::writeTile(unsigned z, size_t tx, size_t ty, const std::vector<uint8_t>& tile) const
+{
+    std::vector<uint8_t> pixels(tile);
+    auto found = m_pathPixels[z].find(uint64_t(ty) * tilesAcross(z) + tx);
+    if (found != m_pathPixels[z].end())
+    {
+        for (uint32_t p : found->second)
+        {
+            pixels[p] = IPV_PATH;
+        }
+    }
+    
+    std::string path = m_directory;
+    makeDirectory(path.c_str());
+    path += "/" + std::to_string(z);
+    makeDirectory(path.c_str());
+    path += "/" + std::to_string(tx);
+    makeDirectory(path.c_str());
+    path += "/" + std::to_string(ty) + ".bmp";
+    
+    std::ofstream out(path.c_str(), std::ofstream::binary);
+    writeBMP(out, &pixels[0], m_options.tileSize, m_options.tileSize,
+        [] (size_t, size_t, uint8_t value) { return value; });
+    return out.good();
+}
+
+} // namespace detail
+
+
 } // namespace visualizer